@@ -22,6 +22,7 @@ static const R_CallMethodDef callMethods[] =
 {
 /* algorithm.c */
 	CALLMETHOD_DEF(triplex_search, 9),
+	CALLMETHOD_DEF(triplex_sweep, 10),
 /* triplex_align.c */
 	CALLMETHOD_DEF(triplex_align, 7),
 	{NULL, NULL, 0}
@@ -46,6 +46,11 @@ void main_align(seq_t dna, t_params params, t_penalization pen)
 {
 	int i, verbose_flag = 0;
 	
+	/* Triplex sequences are short, align them decoded */
+	char *seq = malloc(dna.len + 1);
+	seq_decode(&dna, 0, dna.len, seq);
+	seq[dna.len] = '\0';
+	
 	/* Diag structure array alocation */
 	t_diag *diag = malloc(2*dna.len * sizeof(t_diag));
 	
@@ -71,15 +76,16 @@ void main_align(seq_t dna, t_params params, t_penalization pen)
 	
 	init_matrix(mat, dna.len);
 	
-	search_align(dna.seq, dna.len, diag, &params, &pen, mat);
+	search_align(seq, dna.len, diag, &params, &pen, mat);
 	
 	if (verbose_flag) {
-		print_matrix(mat, dna.seq, dna.len, 0);
+		print_matrix(mat, seq, dna.len, 0);
 	}
-	print_triplex(mat, dna.seq, dna.len);
+	print_triplex(mat, seq, dna.len);
 		
 	free_matrix(mat, dna.len);
 	free(diag);
+	free(seq);
 }
 
 
@@ -13,7 +13,8 @@
 #include "search.h"
 #include "search_interface.h"
 
-seq_t tx_align;
+char *tx_align;
+int64_t tx_align_len;
 int tx_align_pos;
 
 
@@ -24,8 +25,8 @@ int tx_align_pos;
  */
 void Aprintf(char ch)
 {
-	if (tx_align_pos < tx_align.len)
-		tx_align.seq[tx_align_pos++] = ch;
+	if (tx_align_pos < tx_align_len)
+		tx_align[tx_align_pos++] = ch;
 }
 
 
@@ -72,19 +73,19 @@ SEXP triplex_align(
 	set_score_group_tables(INTEGER(st_par), INTEGER(st_apar), INTEGER(gt_par), INTEGER(gt_apar));
 	
 	// Ininitalize global alignment string
-	tx_align.len = 2 * dna.len;
-	tx_align.seq = calloc(tx_align.len, sizeof(char));
+	tx_align_len = 2 * dna.len;
+	tx_align = calloc(tx_align_len, sizeof(char));
 	tx_align_pos = 0;
 	
 	main_align(dna, params, pen);
 	
 	SEXP res;
 	PROTECT(res = allocVector(STRSXP, 1));
-	SET_STRING_ELT(res, 0, mkChar(tx_align.seq));
+	SET_STRING_ELT(res, 0, mkChar(tx_align));
 	UNPROTECT(1);
 	
-	free(dna.seq);
-	free(tx_align.seq);
+	seq_free(&dna);
+	free(tx_align);
 	
 	return res;
 }
@@ -0,0 +1,170 @@
+/**
+ * Triplex package
+ * Detection of processor data cache sizes
+ *
+ * @file    cache.c
+ * @package triplex
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "cache.h"
+
+#if defined(_WIN32)
+
+/**
+ * Get size of data cache of given level from Windows API
+ * @param level Cache level
+ * @return Size in bytes or 0 if unknown
+ */
+static long cache_size_os(int level)
+{
+	SYSTEM_LOGICAL_PROCESSOR_INFORMATION *info;
+	DWORD len = 0;
+	long size = 0;
+	
+	GetLogicalProcessorInformation(NULL, &len);
+	if (len == 0 || (info = malloc(len)) == NULL)
+		return 0;
+	
+	if (GetLogicalProcessorInformation(info, &len))
+	{
+		for (DWORD i = 0; i < len / sizeof(*info); i++)
+		{
+			CACHE_DESCRIPTOR *c = &info[i].Cache;
+			if (info[i].Relationship == RelationCache && c->Level == level &&
+			    (c->Type == CacheData || c->Type == CacheUnified))
+			{
+				size = c->Size;
+				break;
+			}
+		}
+	}
+	free(info);
+	return size;
+}
+
+#elif defined(__APPLE__)
+
+/**
+ * Get size of data cache of given level from sysctl
+ * @param level Cache level
+ * @return Size in bytes or 0 if unknown
+ */
+static long cache_size_os(int level)
+{
+	int64_t size = 0;
+	size_t len = sizeof(size);
+	const char *name = (level == 1) ? "hw.l1dcachesize" : "hw.l2cachesize";
+	
+	if (sysctlbyname(name, &size, &len, NULL, 0) != 0)
+		return 0;
+	
+	return (long) size;
+}
+
+#else
+
+/**
+ * Get size of data cache of given level from sysfs of the first processor
+ * @param level Cache level
+ * @return Size in bytes or 0 if unknown
+ */
+static long cache_size_sysfs(int level)
+{
+	char path[128], type[32], unit;
+	int l;
+	long size;
+	FILE *f;
+	
+	for (int i = 0; i < 16; i++)
+	{
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+		if ((f = fopen(path, "r")) == NULL)
+			break;
+		if (fscanf(f, "%d", &l) != 1)
+			l = 0;
+		fclose(f);
+		if (l != level)
+			continue;
+		
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+		if ((f = fopen(path, "r")) == NULL)
+			continue;
+		if (fscanf(f, "%31s", type) != 1)
+			type[0] = '\0';
+		fclose(f);
+		if (strcmp(type, "Data") != 0 && strcmp(type, "Unified") != 0)
+			continue;
+		
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+		if ((f = fopen(path, "r")) == NULL)
+			continue;
+		l = fscanf(f, "%ld%c", &size, &unit);
+		fclose(f);
+		if (l < 1)
+			continue;
+		if (l == 2 && unit == 'K')
+			size *= 1024;
+		else if (l == 2 && unit == 'M')
+			size *= 1024*1024;
+		return size;
+	}
+	return 0;
+}
+
+
+/**
+ * Get size of data cache of given level from sysconf or sysfs
+ * @param level Cache level
+ * @return Size in bytes or 0 if unknown
+ */
+static long cache_size_os(int level)
+{
+	long size = 0;
+
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+	size = sysconf((level == 1) ? _SC_LEVEL1_DCACHE_SIZE : _SC_LEVEL2_CACHE_SIZE);
+#endif
+	if (size <= 0)
+	// Not provided by all C libraries and architectures
+		size = cache_size_sysfs(level);
+	
+	return size;
+}
+
+#endif
+
+
+/**
+ * Get size of data cache of one processor core
+ * Sizes are detected once and cached.
+ * @param level Cache level, 1 or 2
+ * @return Size in bytes, CACHE_L1_DEFAULT or CACHE_L2_DEFAULT if unknown
+ */
+long cache_size(int level)
+{
+	static long size[2] = {0, 0};
+	
+	if (level < 1 || level > 2)
+		return 0;
+	
+	if (size[level-1] <= 0)
+	{
+		long s = cache_size_os(level);
+		size[level-1] = (s > 0) ? s : (level == 1) ? CACHE_L1_DEFAULT : CACHE_L2_DEFAULT;
+	}
+	return size[level-1];
+}
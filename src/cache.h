@@ -0,0 +1,18 @@
+/**
+ * Triplex package
+ * Header file for detection of processor data cache sizes
+ *
+ * @file    cache.h
+ * @package triplex
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+/* Cache sizes assumed if detection fails */
+#define CACHE_L1_DEFAULT (32*1024)
+#define CACHE_L2_DEFAULT (256*1024)
+
+long cache_size(int level);
+
+#endif // CACHE_H
@@ -16,9 +16,11 @@
 
 /* #define DEBUG */
 
+int test_include(t_dl_list *list, t_dl_node *node);
+
 /*************************************************************************************************/
 /*************************************************************************************************/
-int test_duplication(t_dl_node *lst, t_dl_data *new) {
+int test_duplication(t_dl_list *list, t_dl_node *lst, t_dl_data *new) {
    
    /* the same positions and scores */
    if ((lst->data.start == new->start) && (lst->data.lstart == new->lstart) &&
@@ -32,8 +34,14 @@ int test_duplication(t_dl_node *lst, t_dl_data *new) {
       
    /* score differs - if new one is better then update  */
    if ((lst->data.start == new->start) && (lst->data.end == new->end)) {
-      if (lst->data.score < new->score)
+      /* equal scores keep the leftmost loop, whatever the insertion order */
+      if ((lst->data.score < new->score) ||
+          ((lst->data.score == new->score) && ((new->lstart < lst->data.lstart) ||
+          ((new->lstart == lst->data.lstart) && (new->lend < lst->data.lend))))) {
          lst->data = *new;
+         /* the better one may include other nodes now */
+         test_include(list, lst);
+      }
 #ifdef DEBUG
       Rprintf("Duplication (lower score)\n");
 #endif
@@ -71,8 +79,9 @@ int test_included(t_dl_list *list, t_dl_node *node, t_dl_data *new) {
    while(pointer->data.start == new->start)
       pointer = pointer->prev;
 
-   /* iterate through the nodes with lower start position (to the left) */
-   while(pointer->data.start >= new->start-list->max_len) {
+   /* iterate through the nodes with lower start position (to the left),
+   max_len is the longest range in the list */
+   while((pointer != list->first) && (pointer->data.start >= new->start-list->max_len)) {
       if((pointer->data.end >= new->end) &&
          (pointer->data.score >= new->score)) {
 #ifdef DEBUG
@@ -113,10 +122,10 @@ int test_include(t_dl_list *list, t_dl_node *node) {
       pointer = pointer->next;
 
    /* iterate through the nodes with higher start position and lower end (to
-   right) */
-   while((pointer != NULL) && (pointer->data.end <= new->end)){
+   right), ends are sorted only within the same start */
+   while((pointer != NULL) && (pointer->data.start <= new->end)){
       temp = pointer->next;
-      if (pointer->data.score <= new->score) {
+      if ((pointer->data.end <= new->end) && (pointer->data.score <= new->score)) {
 #ifdef DEBUG
          Rprintf("Node includes node (higher start)\n");
 #endif
@@ -140,7 +149,7 @@ int dl_list_insert(t_dl_list *list, t_dl_data data)
                 pointer = pointer->prev;
         }
         /* Do not insert the same data */
-        if(test_duplication (pointer, &data))
+        if(test_duplication (list, pointer, &data))
            return 0;
         if(test_included(list, pointer, &data))
            return 0;
@@ -157,6 +166,8 @@ int dl_list_insert(t_dl_list *list, t_dl_data data)
         if(pointer->prev == list->last)
            list->last = pointer;
         list->size++;
+        if(data.end - data.start > list->max_len)
+           list->max_len = data.end - data.start;
 
         /* Remove all included nodes with lower score */
         test_include(list, pointer);
@@ -168,7 +179,7 @@ int dl_list_insert(t_dl_list *list, t_dl_data data)
 /*************************************************************************************************/
 int dl_node_overlap(t_dl_node *n1, t_dl_node *n2)
 {
-   int overlap, whole;
+   int64_t overlap, whole;
 
 
    if (n1->data.end > n2->data.start) {
@@ -186,13 +197,14 @@ int dl_node_overlap(t_dl_node *n1, t_dl_node *n2)
 /*************************************************************************************************/
 void local_group_filter(t_dl_list *list, t_dl_node *start, t_dl_node *end)
 {
-   t_dl_node *pointer, *temp;
+   t_dl_node *pointer, *temp, *stop;
    t_dl_node *new_start, *new_end;
    int change;
 
 #ifdef DEBUG
-   Rprintf("Group: (%d,%d) - (%d,%d)\n", start->data.start, start->data.end,
-                                        end->data.start, end->data.end);
+   Rprintf("Group: (%lld,%lld) - (%lld,%lld)\n",
+           (long long) start->data.start, (long long) start->data.end,
+           (long long) end->data.start, (long long) end->data.end);
 #endif
 
    do {
@@ -219,10 +231,12 @@ void local_group_filter(t_dl_list *list, t_dl_node *start, t_dl_node *end)
          pointer = start;
          new_start = start;
          new_end = end;
-         while (pointer != end->next) {
+         /* end may be deleted, so remember where to stop */
+         stop = end->next;
+         while (pointer != stop) {
 #ifdef DEBUG
-            Rprintf("Element: (%d,%d) - %d\n", pointer->data.start,
-               pointer->data.end, pointer->data.type);
+            Rprintf("Element: (%lld,%lld) - %d\n", (long long) pointer->data.start,
+               (long long) pointer->data.end, pointer->data.type);
 #endif
             temp = pointer;
             pointer = pointer->next;
@@ -266,7 +280,7 @@ void dl_list_group_filter(t_dl_list *list)
 
 /*************************************************************************************************/
 /*************************************************************************************************/
-void dl_list_get_head_range(t_dl_list *list, int *start, int *end) 
+void dl_list_get_head_range(t_dl_list *list, int64_t *start, int64_t *end) 
 {
    t_dl_node *pointer = (list->first)->next;
 
@@ -280,18 +294,22 @@ void dl_list_get_head_range(t_dl_list *list, int *start, int *end)
 /*************************************************************************************************/
 void dl_list_merge_sort(t_dl_list *list_arr, t_dl_list *list_out, int num)
 {
-   int i, min_list, min_start, min_end, act_start, act_end, items = 0;
+   int i, min_list;
+   int64_t min_start, min_end, act_start, act_end, items = 0;
    t_dl_node *pointer;
 
    /* Initialization of output list */
    dl_list_init(list_out, list_arr[0].max_len);
 
-   /* Overall number of items */
-   for(i=0; i<num; i++)
+   /* Overall number of items and the longest range */
+   for(i=0; i<num; i++) {
       items += list_arr[i].size;
+      if (list_arr[i].max_len > list_out->max_len)
+         list_out->max_len = list_arr[i].max_len;
+   }
 
 #ifdef DEBUG
-   Rprintf("Items %d\n", items);
+   Rprintf("Items %lld\n", (long long) items);
 #endif
 
    while(items > 0) {
@@ -389,6 +407,45 @@ void dl_list_free(t_dl_list *list)
    list->max_len = 0;
 }
 
+/*************************************************************************************************/
+/*************************************************************************************************/
+void dl_buf_init(t_dl_buf *buf)
+{
+        buf->size = 0;
+        buf->max_size = 0;
+        buf->failed = 0;
+        buf->data = NULL;
+}
+
+/*************************************************************************************************/
+/*************************************************************************************************/
+void dl_buf_push(t_dl_buf *buf, t_dl_data data)
+{
+        t_dl_data *temp;
+
+        /* Called from search threads, so there is no error() here,
+        the failure is reported after the search */
+        if (buf->size == buf->max_size) {
+           temp = (t_dl_data *)realloc(buf->data,
+              (2*buf->max_size + 64) * sizeof(t_dl_data));
+           if (temp == NULL) {
+              buf->failed = 1;
+              return;
+           }
+           buf->data = temp;
+           buf->max_size = 2*buf->max_size + 64;
+        }
+        buf->data[buf->size++] = data;
+}
+
+/*************************************************************************************************/
+/*************************************************************************************************/
+void dl_buf_free(t_dl_buf *buf)
+{
+        free(buf->data);
+        dl_buf_init(buf);
+}
+
 /*************************************************************************************************/
 /*************************************************************************************************/
 void dl_list_print(t_dl_list *list)
@@ -397,8 +454,8 @@ void dl_list_print(t_dl_list *list)
         /* t_dl_node *pointer = list->first; */
 
         while(pointer!=NULL) {
-            Rprintf("[%d,%d:%d]", pointer->data.start, 
-                                 pointer->data.end, 
+            Rprintf("[%lld,%lld:%d]", (long long) pointer->data.start, 
+                                 (long long) pointer->data.end, 
                                  pointer->data.score);
 /*
             Rprintf("(");
@@ -419,14 +476,14 @@ void dl_list_print(t_dl_list *list)
 */
             pointer = pointer->next;
         }
-        Rprintf("\nList size: %d", list->size);
+        Rprintf("\nList size: %lld", (long long) list->size);
         Rprintf("\n");
 }
 
 /*************************************************************************************************/
 /*************************************************************************************************/
-void assign_data(t_dl_data *data, int start, int lstart, 
-                 int lend, int end, int score) {
+void assign_data(t_dl_data *data, int64_t start, int64_t lstart, 
+                 int64_t lend, int64_t end, int score) {
    data->start = start;
    data->lstart = lstart;
    data->lend = lend;
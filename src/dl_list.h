@@ -11,13 +11,15 @@
 #ifndef DL_LIST_H
 #define DL_LIST_H
 
+#include <stdint.h>
+
 typedef struct DL_Data
 {
 	int type;
-	int start;
-	int end;
-	int lstart;
-	int lend;
+	int64_t start;
+	int64_t end;
+	int64_t lstart;
+	int64_t lend;
 	int score;
 	double pvalue;
 	int insdel;
@@ -33,17 +35,28 @@ typedef struct DL_Node
 
 typedef struct
 {
-	int    size;
+	int64_t size;
 	int    max_len;
 	struct DL_Node *first;
 	struct DL_Node *last;
 } t_dl_list;
 
+typedef struct
+{// Results in order of their export, inserted into a list later
+	int64_t size;
+	int64_t max_size;
+	int    failed;
+	struct DL_Data *data;
+} t_dl_buf;
+
 void dl_list_init(t_dl_list *list, int max_len);
 void dl_list_delete(t_dl_list *list, t_dl_node *node);
 int dl_list_insert(t_dl_list *list, t_dl_data data);
 void dl_list_free(t_dl_list *list);
 void dl_list_merge_sort(t_dl_list *list_arr, t_dl_list *list_out, int num);
 void dl_list_group_filter(t_dl_list *list);
+void dl_buf_init(t_dl_buf *buf);
+void dl_buf_push(t_dl_buf *buf, t_dl_data data);
+void dl_buf_free(t_dl_buf *buf);
 
 #endif // DL_LIST_H
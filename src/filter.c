@@ -0,0 +1,166 @@
+/**
+ * Triplex package
+ * Lossless prefilter of triplex search
+ *
+ * Every step of a triplex path pairs one base of the 3' half of the stem
+ * with one base of the 5' half, or skips a base of one half. So the score
+ * of a path is at most the sum of the best step of every base of the 3'
+ * half, and likewise of the 5' half. Bases without any triplet of the type
+ * can only be skipped or mismatched, so a stretch of sequence can reach
+ * min_score only if its sum of best steps does, e.g. polypurine tracts for
+ * parallel types. Parts of chunks without such stretches are cut out.
+ *
+ * The filter is exact. A cell depends only on the bases between its rows,
+ * so cells of a kept part are computed as in the whole chunk, and every
+ * cell reaching min_score lies FILTER_MARGIN bases inside its part.
+ * Triplexes are exported at such cells on the chunk border or at the end
+ * of their diagonal, or at the next cell of their diagonal, given the
+ * cells one antidiagonal back. All of these lie in the part for a margin
+ * of at least one base. So no cell on the border of a part exports, and
+ * the part exports the same triplexes as the chunk.
+ *
+ * @file    filter.c
+ * @package triplex
+ */
+
+#include <R.h>
+#include <Rinternals.h>
+
+#include <stdlib.h>
+
+#include "filter.h"
+
+
+/**
+ * Get the best steps of bases of given type
+ * @param tri_type Triplex type
+ * @param pen Penalizations
+ * @param row Output best step of bases of the 3' half
+ * @param col Output best step of bases of the 5' half
+ * @return 0 if steps are not bounded by bases, e.g. negative penalization
+ */
+static int filter_steps(int tri_type, t_penalization *pen, int row[NBASES], int col[NBASES])
+{
+	int iso = (pen->iso_stay > -pen->iso_change) ? pen->iso_stay : -pen->iso_change;
+	int skip = (-pen->mismatch > -pen->insertion) ? -pen->mismatch : -pen->insertion;
+	
+	if (pen->insertion < 0)
+	// Skipped bases of the other half would increase the score
+		return 0;
+	
+	if (iso < 0)
+		iso = 0;
+	
+	for (int a = 0; a < NBASES; a++)
+	{
+		row[a] = col[a] = skip;
+		for (int b = 0; b < NBASES; b++)
+		{
+			if (TAB_SCORE[tri_type][a][b] <= TM)
+				continue;
+			if (row[a] < TAB_SCORE[tri_type][a][b] + iso)
+				row[a] = TAB_SCORE[tri_type][a][b] + iso;
+		}
+		for (int b = 0; b < NBASES; b++)
+		{
+			if (TAB_SCORE[tri_type][b][a] <= TM)
+				continue;
+			if (col[a] < TAB_SCORE[tri_type][b][a] + iso)
+				col[a] = TAB_SCORE[tri_type][b][a] + iso;
+		}
+	}
+	return 1;
+}
+
+
+/**
+ * Get parts of chunks which may contain a triplex of given type
+ * A triplex with 5' end s and 3' end e needs a stretch of the 5' half
+ * starting at s and a stretch of the 3' half ending at e, both with sum
+ * of best steps at least min_score, and e - s lower than span.
+ * @param dna Encoded DNA sequence
+ * @param chunk Interval list of chunks divided by N or - symbols
+ * @param tri_type Triplex type
+ * @param pen Penalizations
+ * @param min_score Minimal score
+ * @param span Number of antidiagonals of a triplex
+ * @return Kept parts of chunks in sequence order
+ */
+intv_t *get_tract_chunks(
+	seq_t dna, intv_t *chunk, int tri_type, t_penalization *pen,
+	int min_score, int span)
+{
+	int row[NBASES], col[NBASES];
+	
+	// Create first interval as a list header
+	intv_t header = {0, 0, NULL};
+	intv_t *last = &header;
+	
+	if (min_score <= 0 || !filter_steps(tri_type, pen, row, col))
+	{// Nothing can be cut out
+		for (intv_t *c = chunk; c != NULL; c = c->next)
+		{
+			last->next = new_intv(c->start, c->end);
+			last = last->next;
+		}
+		return header.next;
+	}
+	
+	/* Stretches of the 5' half starting at every base, one bit per base */
+	uint64_t *start_ok = calloc((size_t) (dna.len + 63)/64 + 1, sizeof(uint64_t));
+	if (start_ok == NULL)
+		error("Failed to allocate memory for prefilter.");
+	
+	for (intv_t *c = chunk; c != NULL; c = c->next)
+	{
+		int sum = 0;
+		
+		for (int64_t s = c->end; s >= c->start; s--)
+		{
+			sum = ((sum > 0) ? sum : 0) + col[SEQ_BASE(dna, s)];
+			if (sum >= min_score)
+				start_ok[s >> 6] |= (uint64_t) 1 << (s & 63);
+		}
+		
+		int64_t wstart = 0, wend = -1, first = c->start;
+		
+		sum = 0;
+		for (int64_t e = c->start; e <= c->end; e++)
+		{
+			sum = ((sum > 0) ? sum : 0) + row[SEQ_BASE(dna, e)];
+			if (sum < min_score)
+				continue;
+			
+			/* The first 5' end in reach of the 3' end e */
+			if (first < e - span + 1)
+				first = e - span + 1;
+			while (first < e && !((start_ok[first >> 6] >> (first & 63)) & 1))
+				first++;
+			if (first == e)
+				continue;
+			
+			/* Margin for steps out of the triplex, which decide on its export */
+			int64_t start = (first - FILTER_MARGIN > c->start) ? first - FILTER_MARGIN : c->start;
+			int64_t end = (e + FILTER_MARGIN < c->end) ? e + FILTER_MARGIN : c->end;
+			
+			if (start > wend + 1)
+			{// Export previous part
+				if (wend >= wstart)
+				{
+					last->next = new_intv(wstart, wend);
+					last = last->next;
+				}
+				wstart = start;
+			}
+			wend = end;
+		}
+		if (wend >= wstart)
+		{// Export last part of the chunk
+			last->next = new_intv(wstart, wend);
+			last = last->next;
+		}
+	}
+	free(start_ok);
+	
+	return header.next;
+}
@@ -0,0 +1,23 @@
+/**
+ * Triplex package
+ * Header file for lossless prefilter of triplex search
+ *
+ * @file    filter.h
+ * @package triplex
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include "libtriplex.h"
+
+/* Bases kept around every stretch able to hold a triplex, at least one
+ * for the export of its triplexes, @see filter.c */
+#define FILTER_MARGIN 2
+
+intv_t *get_tract_chunks(
+	seq_t dna, intv_t *chunk, int tri_type, t_penalization *pen,
+	int min_score, int span
+);
+
+#endif // FILTER_H
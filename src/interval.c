@@ -19,7 +19,7 @@
  * @param end Interval end
  * @return Pointer to new interval
  */
-intv_t *new_intv(int start, int end)
+intv_t *new_intv(int64_t start, int64_t end)
 {
 	intv_t *intv = malloc(sizeof(intv_t));
 	if (intv == NULL)
@@ -59,7 +59,66 @@ void print_intv(intv_t *intv)
 	
 	while (intv != NULL)
 	{
-		Rprintf("%d, %d\n", intv->start, intv->end);
+		Rprintf("%lld, %lld\n", (long long) intv->start, (long long) intv->end);
 		intv = intv->next;
 	}
 }
+
+
+/**
+ * Initialize interval array
+ * @param buf Interval array
+ * @param max_size Number of preallocated intervals
+ */
+void intv_buf_init(intv_buf_t *buf, int max_size)
+{
+	buf->size = 0;
+	buf->max_size = max_size;
+	buf->start = malloc(max_size * sizeof(int));
+	buf->end = malloc(max_size * sizeof(int));
+	if (buf->start == NULL || buf->end == NULL)
+		error("Failed to allocate memory for interval array.");
+}
+
+
+/**
+ * Append interval to the array
+ * NOTE Called from search threads, so there is no error() here
+ * @param buf Interval array
+ * @param start Interval start
+ * @param end Interval end
+ * @return 0 on success, -1 if the array failed to grow
+ */
+int intv_buf_push(intv_buf_t *buf, int start, int end)
+{
+	if (buf->size == buf->max_size)
+	{
+		int max_size = 2*buf->max_size + 64;
+		int *tmp;
+		
+		if ((tmp = realloc(buf->start, max_size * sizeof(int))) == NULL)
+			return -1;
+		buf->start = tmp;
+		if ((tmp = realloc(buf->end, max_size * sizeof(int))) == NULL)
+			return -1;
+		buf->end = tmp;
+		buf->max_size = max_size;
+	}
+	buf->start[buf->size] = start;
+	buf->end[buf->size] = end;
+	buf->size++;
+	return 0;
+}
+
+
+/**
+ * Free interval array
+ * @param buf Interval array
+ */
+void intv_buf_free(intv_buf_t *buf)
+{
+	free(buf->start);
+	free(buf->end);
+	buf->start = buf->end = NULL;
+	buf->size = buf->max_size = 0;
+}
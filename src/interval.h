@@ -11,15 +11,30 @@
 #ifndef INTERVAL_H
 #define INTERVAL_H
 
+#include <stdint.h>
+
 typedef struct intv
-{
-	int start;
-	int end;
+{// Interval of sequence positions
+	int64_t start;
+	int64_t end;
 	struct intv *next;
 } intv_t;
 
-intv_t *new_intv(int start, int end);
+typedef struct
+{// Array of intervals in increasing order, storage is kept for reuse,
+ // positions are relative to a piece of the sequence
+	int size;
+	int max_size;
+	int *start;
+	int *end;
+} intv_buf_t;
+
+intv_t *new_intv(int64_t start, int64_t end);
 void free_intv(intv_t *intv);
 void print_intv(intv_t *intv);
 
+void intv_buf_init(intv_buf_t *buf, int max_size);
+int intv_buf_push(intv_buf_t *buf, int start, int end);
+void intv_buf_free(intv_buf_t *buf);
+
 #endif // INTERVAL_H
@@ -0,0 +1,876 @@
+/**
+ * Triplex package
+ * Antidiagonal search kernels
+ *
+ * @file    kernel.c
+ * @package triplex
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "kernel.h"
+
+#if !defined(TRIPLEX_NO_SIMD) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define KERNEL_X86
+#include <immintrin.h>
+#endif
+
+#ifdef __GNUC__
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+#else
+#define KERNEL_INLINE static inline
+#endif
+
+/* Default penalization, @see triplex.search */
+#define PEN_DTWIST     7
+#define PEN_INSERTION  9
+#define PEN_ISO_CHANGE 5
+#define PEN_ISO_STAY   0
+#define PEN_MISMATCH   7
+
+/* Built-in TAB_SCORE indexed by triplex type and a*4+b, kernels
+ * specialised for a triplex type are used only while the global
+ * table keeps these values */
+static const int8_t KERN_SCORE[NUM_TRI_TYPES][NBASES*NBASES] =
+{
+	{-9, -9, -9, -9, -9, 2, -9, -9, 2, 1, -9, -9, -9, 1, 1, 2},
+	{-9, -9, 2, -9, -9, 2, 1, 1, -9, -9, -9, 1, -9, -9, -9, 2},
+	{2, 1, 1, -9, -9, -9, 1, 2, -9, -9, 2, -9, -9, -9, -9, -9},
+	{2, -9, -9, -9, 1, -9, -9, -9, 1, 1, 2, -9, -9, 2, -9, -9},
+	{-9, -9, 1, 2, -9, 2, -9, -9, -9, -9, -9, 1, -9, 1, -9, 2},
+	{-9, -9, -9, -9, -9, 2, -9, 1, 1, -9, -9, -9, 2, -9, 1, 2},
+	{2, -9, 1, -9, 1, -9, -9, -9, -9, -9, 2, -9, 2, 1, -9, -9},
+	{2, 1, -9, 2, -9, -9, -9, 1, 1, -9, 2, -9, -9, -9, -9, -9},
+};
+
+
+/* Store value v to field f of t_dstate at index k, @see DS_GET */
+#define DS_SET(ds, f, k, v) do { \
+	if ((ds)->wide) (ds)->w.f[k] = (v); else (ds)->f[k] = (v); \
+} while (0)
+
+
+/**
+ * Get memory size needed by t_dstate
+ * NOTE Block for n diagonals is big enough for any lower n
+ * @param n Number of diagonals
+ * @param wide Wide state
+ * @return Size in bytes
+ */
+size_t dstate_size(int n, int wide)
+{
+	size_t half = (n + 1)/2;
+	size_t size = 2*half*(wide ? DS_WIDE_DIAG_SIZE : DS_DIAG_SIZE);
+	// Round up to cache line, so that blocks can be stored one after another
+	return (size + 63) & ~((size_t) 63);
+}
+
+
+/**
+ * Assign arrays of t_dstate in given memory block
+ * @param ds Diagonal state
+ * @param mem Memory block of dstate_size(n, wide) bytes
+ * @param n Number of diagonals
+ * @param wide Wide state
+ */
+void dstate_init(t_dstate *ds, void *mem, int n, int wide)
+{
+	int size = 2*((n + 1)/2);
+	
+	memset(ds, 0, sizeof(*ds));
+	ds->half = (n + 1)/2;
+	ds->wide = wide;
+	if (wide)
+	{// Wide arrays replace the narrow ones
+		ds->w.score = mem;
+		ds->w.max_score = ds->w.score + size;
+		ds->w.start_diag = ds->w.max_score + size;
+		ds->w.start_antidiag = ds->w.start_diag + size;
+		ds->w.max_diag = ds->w.start_antidiag + size;
+		ds->w.max_antidiag = ds->w.max_diag + size;
+		ds->w.indels = ds->w.max_antidiag + size;
+		ds->w.max_indels = ds->w.indels + size;
+		ds->trip = (uint8_t *) (ds->w.max_indels + size);
+		ds->ptrip = ds->trip + size;
+		ds->flags = ds->ptrip + size;
+		return;
+	}
+	ds->score = mem;
+	ds->max_score = ds->score + size;
+	ds->start_diag = ds->max_score + size;
+	ds->start_antidiag = ds->start_diag + size;
+	ds->max_diag = ds->start_antidiag + size;
+	ds->max_antidiag = ds->max_diag + size;
+	ds->trip = (uint8_t *) (ds->max_antidiag + size);
+	ds->ptrip = ds->trip + size;
+	ds->flags = ds->ptrip + size;
+	ds->indels = ds->flags + size;
+	ds->max_indels = ds->indels + size;
+}
+
+
+/**
+ * Initialize one diagonal before piece search
+ * @param ds Diagonal state
+ * @param d Diagonal
+ * @param min_loop Minimal loop length
+ */
+static inline void dstate_reset_diag(t_dstate *ds, int d, int min_loop)
+{
+	int k = DS_IDX(ds, d);
+	int start_antidiag = (((min_loop+d) % 2) == 0) ? min_loop+1 : min_loop+2;
+	
+	DS_SET(ds, score, k, 0);
+	DS_SET(ds, max_score, k, 0);
+	ds->trip[k] = TRIP_NONE;
+	ds->ptrip[k] = TRIP_NONE;
+	ds->flags[k] = STAT_NONE | DP_MISMATCH << FL_RULE_SHIFT;
+	DS_SET(ds, start_diag, k, 0);
+	DS_SET(ds, start_antidiag, k, start_antidiag);
+	DS_SET(ds, max_diag, k, 0);
+	DS_SET(ds, max_antidiag, k, start_antidiag);
+	DS_SET(ds, indels, k, 0);
+	DS_SET(ds, max_indels, k, 0);
+}
+
+
+/**
+ * Initialize diagonals before piece search
+ * @param ds Diagonal state
+ * @param n Number of diagonals
+ * @param min_loop Minimal loop length
+ */
+void dstate_reset(t_dstate *ds, int n, int min_loop)
+{
+	for (int d = 0; d < n; d++)
+		dstate_reset_diag(ds, d, min_loop);
+}
+
+
+/**
+ * Hand diagonals over to the next piece of a stream
+ * Diagonal d in first..last becomes diagonal d - shift, the others
+ * are initialized. Shift must be even, so diagonals keep their plane.
+ * @param ds Diagonal state
+ * @param first First diagonal to keep
+ * @param last Last diagonal to keep
+ * @param shift Offset change of the piece in diagonals
+ * @param n Number of diagonals
+ * @param min_loop Minimal loop length
+ */
+void dstate_shift(t_dstate *ds, int first, int last, int shift, int n, int min_loop)
+{
+	for (int par = 0; par < 2; par++)
+	{// Diagonals of one parity are stored contiguously
+		int f = first + ((first & 1) != par);
+		int l = last - ((last & 1) != par);
+		if (f > l)
+			continue;
+		
+		int src = DS_IDX(ds, f), dst = DS_IDX(ds, f - shift), cnt = (l - f)/2 + 1;
+#define DS_MOVE(arr) memmove((arr) + dst, (arr) + src, cnt*sizeof(*(arr)))
+		if (ds->wide)
+		{
+			DS_MOVE(ds->w.score);
+			DS_MOVE(ds->w.max_score);
+			DS_MOVE(ds->w.start_diag);
+			DS_MOVE(ds->w.start_antidiag);
+			DS_MOVE(ds->w.max_diag);
+			DS_MOVE(ds->w.max_antidiag);
+			DS_MOVE(ds->w.indels);
+			DS_MOVE(ds->w.max_indels);
+		}
+		else
+		{
+			DS_MOVE(ds->score);
+			DS_MOVE(ds->max_score);
+			DS_MOVE(ds->start_diag);
+			DS_MOVE(ds->start_antidiag);
+			DS_MOVE(ds->max_diag);
+			DS_MOVE(ds->max_antidiag);
+			DS_MOVE(ds->indels);
+			DS_MOVE(ds->max_indels);
+		}
+		DS_MOVE(ds->trip);
+		DS_MOVE(ds->ptrip);
+		DS_MOVE(ds->flags);
+#undef DS_MOVE
+	}
+	for (int d = 0; d < n; d++)
+	{
+		if (d < first - shift || d > last - shift)
+			dstate_reset_diag(ds, d, min_loop);
+	}
+}
+
+
+/**
+ * Find the first diagonal with score over or under the treshold
+ * Both parity planes are compared 8 diagonals at once with SSE2.
+ * @param ds Diagonal state
+ * @param first First diagonal to check
+ * @param last Last diagonal to check
+ * @param treshold Pruning treshold
+ * @param over Find score >= treshold if nonzero, score < treshold otherwise
+ * @return Diagonal number or last+1 if there is none
+ */
+int dstate_find(const t_dstate *ds, int first, int last, int treshold, int over)
+{
+	if (ds->wide)
+	{
+		for (int d = first; d <= last; d++)
+		{
+			if ((ds->w.score[DS_IDX(ds, d)] >= treshold) == (over != 0))
+				return d;
+		}
+		return last + 1;
+	}
+	
+	if (treshold <= INT16_MIN)
+	// All scores are over the treshold
+		return over ? first : last + 1;
+	if (treshold > INT16_MAX)
+		return over ? last + 1 : first;
+	
+#if defined(KERNEL_X86) && defined(__SSE2__)
+	__m128i tres = _mm_set1_epi16(treshold);
+	int j = first >> 1;
+	
+	for (; 2*j <= last && j + 8 <= ds->half; j += 8)
+	{// Bit k of the mask is diagonal 2*j + k
+		__m128i even = _mm_cmplt_epi16(_mm_loadu_si128((const __m128i *) (ds->score + j)), tres);
+		__m128i odd = _mm_cmplt_epi16(_mm_loadu_si128((const __m128i *) (ds->score + ds->half + j)), tres);
+		unsigned mask = _mm_movemask_epi8(_mm_packs_epi16(
+			_mm_unpacklo_epi16(even, odd), _mm_unpackhi_epi16(even, odd)
+		));
+		
+		if (over)
+			mask = ~mask & 0xFFFF;
+		if (2*j < first)
+			mask &= ~1u;
+		if (last - 2*j < 15)
+			mask &= (2u << (last - 2*j)) - 1;
+		if (mask)
+			return 2*j + __builtin_ctz(mask);
+	}
+	if (first < 2*j)
+		first = 2*j;
+#endif
+	for (int d = first; d <= last; d++)
+	{
+		if ((ds->score[DS_IDX(ds, d)] >= treshold) == (over != 0))
+			return d;
+	}
+	return last + 1;
+}
+
+
+/**
+ * Find the first score reaching the treshold
+ * Narrow scores are compared 8 at once with SSE2.
+ * @param ds Diagonal state
+ * @param k Index of the first score, e.g. first cell of one antidiagonal
+ * @param count Number of scores
+ * @param treshold Treshold
+ * @return Offset of the score from k or count if there is none
+ */
+int scores_find(const t_dstate *ds, int k, int count, int treshold)
+{
+	int j = 0;
+	
+	if (ds->wide)
+	{
+		const int32_t *score = ds->w.score + k;
+		for (; j < count; j++)
+		{
+			if (score[j] >= treshold)
+				return j;
+		}
+		return count;
+	}
+	
+	const int16_t *score = ds->score + k;
+	
+	if (treshold <= INT16_MIN)
+		return 0;
+	if (treshold > INT16_MAX)
+		return count;
+	
+#if defined(KERNEL_X86) && defined(__SSE2__)
+	__m128i tres = _mm_set1_epi16(treshold - 1);
+	
+	for (; j + 32 <= count; j += 32)
+	{// Four vectors per step, most scores are under the treshold
+		__m128i a = _mm_cmpgt_epi16(_mm_loadu_si128((const __m128i *) (score + j)), tres);
+		__m128i b = _mm_cmpgt_epi16(_mm_loadu_si128((const __m128i *) (score + j + 8)), tres);
+		__m128i c = _mm_cmpgt_epi16(_mm_loadu_si128((const __m128i *) (score + j + 16)), tres);
+		__m128i d = _mm_cmpgt_epi16(_mm_loadu_si128((const __m128i *) (score + j + 24)), tres);
+		
+		if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))))
+			break;
+	}
+#endif
+	for (; j < count; j++)
+	{
+		if (score[j] >= treshold)
+			return j;
+	}
+	return count;
+}
+
+
+/* Field access of scalar_cells, wide is constant in every kernel */
+#define C_GET(f, k) (wide ? ds->w.f[k] : ds->f[k])
+#define C_SET(f, k, v) do { if (wide) ds->w.f[k] = (v); else ds->f[k] = (v); } while (0)
+
+/**
+ * Copy diagonal state to the neighbouring diagonal
+ * @param ds Diagonal state
+ * @param dst Destination index
+ * @param src Source index
+ * @param shift Destination minus source diagonal
+ * @param wide Wide diagonal state
+ */
+static inline void dstate_copy(t_dstate *ds, int dst, int src, int shift, int wide)
+{
+	C_SET(score, dst, C_GET(score, src));
+	C_SET(max_score, dst, C_GET(max_score, src));
+	C_SET(start_diag, dst, C_GET(start_diag, src) - shift);
+	C_SET(start_antidiag, dst, C_GET(start_antidiag, src));
+	C_SET(max_diag, dst, C_GET(max_diag, src) - shift);
+	C_SET(max_antidiag, dst, C_GET(max_antidiag, src));
+	ds->trip[dst] = ds->trip[src];
+	ds->ptrip[dst] = ds->ptrip[src];
+	ds->flags[dst] = ds->flags[src];
+	C_SET(indels, dst, C_GET(indels, src));
+	C_SET(max_indels, dst, C_GET(max_indels, src));
+}
+
+
+/* Score lookup of scalar_cells */
+#define K_SCORE(a, b) ((type < 0) ? TAB_SCORE[tri_type][a][b] : KERN_SCORE[type][(a)*NBASES+(b)])
+
+/**
+ * Compute cells of one antidiagonal, scalar version
+ * Same rules as get_max_score followed by status update and export
+ * of finished triplexes, @see search. Specialised kernels inline it
+ * with constant type, def_pen, use_indel and wide, so table lookups,
+ * penalties, indel transitions and field widths are resolved at compile
+ * time.
+ * @param c Search context
+ * @param ad Antidiagonal number
+ * @param first First row
+ * @param last Last row
+ * @param type Triplex type of built-in tables or -1 for TAB_SCORE/TAB_GROUP
+ * @param def_pen Use default penalization instead of c->pen
+ * @param use_indel Consider indels, 0 only if kernel_noindel_safe holds
+ * @param wide Wide diagonal state, @see kernel_wide
+ * @return Number of cells under c->treshold
+ */
+KERNEL_INLINE int scalar_cells(
+	t_kctx *c, int ad, int first, int last, int type, int def_pen, int use_indel, int wide)
+{
+	/* Local copy of array pointers, byte stores could alias them otherwise */
+	t_dstate dsl = *c->ds;
+	t_dstate *ds = &dsl;
+	t_params *params = c->params;
+	t_penalization *p = c->pen;
+	const uint16_t *iso = c->kern->iso;
+	const char *piece = c->piece;
+	int tri_type = (type < 0) ? params->tri_type : type;
+	int reset = (ad <= params->max_loop);
+	int under = 0;
+	
+	int insertion = def_pen ? PEN_INSERTION : p->insertion;
+	int iso_change = def_pen ? PEN_ISO_CHANGE : p->iso_change;
+	int iso_stay = def_pen ? PEN_ISO_STAY : p->iso_stay;
+	int mismatch = def_pen ? PEN_MISMATCH : p->mismatch;
+	
+	/* Cell in row i is diagonal d = 2*i - ad + 1, its left and right
+	 * neighbours d-1 and d+1 are stored in the other plane */
+	int kc = ((ad + 1) & 1)*ds->half - (ad >> 1);
+	int kn = (ad & 1)*ds->half - (ad >> 1) - (ad & 1);
+	
+	for (int i = first; i <= last; i++)
+	{
+		int d = 2*i - ad + 1;
+		int k = kc + i, l = kn + i, r = kn + i + 1;
+		unsigned char a = piece[i], b = piece[i-ad];
+		int trip = a*NBASES + b;
+		int incscore, mm_score, length, status, rule;
+		
+		incscore = K_SCORE(a, b);
+		if (incscore > TM)
+		{// Match
+			mm_score = C_GET(score, k) + incscore;
+			if (FL_RULE(ds->flags[k]) == DP_MATCH)
+			{// Check isomorphic group
+				if ((iso[TRIP_IDX(ds->ptrip[k])*TRIP_N + TRIP_IDX(ds->trip[k])] >> trip) & 1)
+				{
+					mm_score -= iso_change;
+				}
+				else
+				{
+					mm_score += iso_stay;
+				}
+			}
+		}
+		else
+		{// Mismatch
+			mm_score = C_GET(score, k) - mismatch;
+		}
+		
+		if (!use_indel || ((mm_score >= C_GET(score, l) - insertion) &&
+		               (mm_score >= C_GET(score, r) - insertion)))
+		{// Match/mismatch is better
+			C_SET(score, k, mm_score);
+			rule = DP_MISMATCH;
+			
+			if (incscore > TM)
+			{// Match
+				rule = DP_MATCH;
+				ds->ptrip[k] = ds->trip[k];
+				ds->trip[k] = trip;
+				
+				if (mm_score >= C_GET(max_score, k))
+				{
+					C_SET(max_score, k, mm_score);
+					C_SET(max_diag, k, 0);
+					C_SET(max_antidiag, k, ad);
+					C_SET(max_indels, k, C_GET(indels, k));
+				}
+			}
+		}
+		else
+		{// Insertion or deletion
+			if (C_GET(score, l) > C_GET(score, r))
+			{// Get from left diagonal
+				dstate_copy(ds, k, l, 1, wide);
+				C_SET(score, k, C_GET(score, l) - insertion);
+				rule = DP_LEFT;
+			}
+			else
+			{// Get from right diagonal
+				dstate_copy(ds, k, r, -1, wide);
+				C_SET(score, k, C_GET(score, r) - insertion);
+				rule = DP_RIGHT;
+			}
+			C_SET(indels, k, C_GET(indels, k) + 1);
+		}
+		
+		if (reset && (C_GET(score, k) < 0))
+		{// Local alignment only for loop
+			C_SET(score, k, 0);
+			C_SET(max_score, k, 0);
+			C_SET(start_diag, k, 0);
+			C_SET(start_antidiag, k, ad);
+			C_SET(max_diag, k, 0);
+			C_SET(max_antidiag, k, ad);
+			C_SET(indels, k, 0);
+			C_SET(max_indels, k, 0);
+		}
+		
+		length = get_length(C_GET(start_antidiag, k), C_GET(max_antidiag, k), C_GET(max_indels, k));
+		status = ds->flags[k] & FL_STATUS;
+		status = (length >= params->min_len) ? status|STAT_MINLEN : status&(~STAT_MINLEN);
+		
+		/* Actual score satisfies the required quality */
+		if (C_GET(score, k) >= params->min_score)
+		{
+			status |= STAT_QUALITY;
+			/* If triplex can not continue, then export */
+			if ((status & STAT_MINLEN) && ((i - ad == c->first_row) || (i == c->last_row)))
+			{
+				status = STAT_EXPORT;
+				export_diag(c, d);
+			}
+		}
+		/* Actual score does not satisfy the required quality */
+		else
+		{
+		/* If quality requirement was satisfied in previous step, then export */
+			if(
+				(!(ds->flags[l] & STAT_QUALITY)) && (!(ds->flags[r] & STAT_QUALITY)) &&
+				((status & STAT_QUALITY)) && ((status & STAT_MINLEN)))
+			{
+				status = STAT_EXPORT;
+				export_diag(c, d);
+				C_SET(max_score, k, 0);
+			}
+			else {
+				status = STAT_NONE;
+			}
+		}
+		ds->flags[k] = status | rule << FL_RULE_SHIFT;
+		
+		if (C_GET(score, k) < c->treshold)
+			under++;
+	}
+	return under;
+}
+
+#undef K_SCORE
+#undef C_GET
+#undef C_SET
+
+
+/**
+ * Compute cells of one antidiagonal, generic scalar version
+ * @see scalar_cells
+ */
+int kernel_scalar(t_kctx *c, int ad, int first, int last)
+{
+	return scalar_cells(c, ad, first, last, -1, 0, 1, 0);
+}
+
+
+/**
+ * Scalar kernel for custom tables and default penalization
+ * @see scalar_cells
+ */
+static int kernel_scalar_def(t_kctx *c, int ad, int first, int last)
+{
+	return scalar_cells(c, ad, first, last, -1, 1, 1, 0);
+}
+
+
+/**
+ * Compute cells of one antidiagonal without indels, scalar version
+ * @see scalar_cells
+ */
+static int kernel_scalar_noindel(t_kctx *c, int ad, int first, int last)
+{
+	return scalar_cells(c, ad, first, last, -1, 0, 0, 0);
+}
+
+
+/**
+ * Compute cells of one antidiagonal in wide diagonal state
+ * @see scalar_cells
+ */
+static int kernel_scalar_wide(t_kctx *c, int ad, int first, int last)
+{
+	return scalar_cells(c, ad, first, last, -1, 0, 1, 1);
+}
+
+
+/**
+ * Compute cells of one antidiagonal in wide diagonal state without indels
+ * @see scalar_cells
+ */
+static int kernel_scalar_wide_noindel(t_kctx *c, int ad, int first, int last)
+{
+	return scalar_cells(c, ad, first, last, -1, 0, 0, 1);
+}
+
+
+/* Scalar kernels for built-in tables of triplex type t */
+#define KERNEL_SCALAR_TYPE(t) \
+static int kernel_scalar_t##t(t_kctx *c, int ad, int first, int last) \
+{ \
+	return scalar_cells(c, ad, first, last, t, 0, 1, 0); \
+} \
+static int kernel_scalar_t##t##_def(t_kctx *c, int ad, int first, int last) \
+{ \
+	return scalar_cells(c, ad, first, last, t, 1, 1, 0); \
+}
+
+KERNEL_SCALAR_TYPE(0)
+KERNEL_SCALAR_TYPE(1)
+KERNEL_SCALAR_TYPE(2)
+KERNEL_SCALAR_TYPE(3)
+KERNEL_SCALAR_TYPE(4)
+KERNEL_SCALAR_TYPE(5)
+KERNEL_SCALAR_TYPE(6)
+KERNEL_SCALAR_TYPE(7)
+
+#undef KERNEL_SCALAR_TYPE
+
+/* Scalar kernels indexed by triplex type and default penalization flag */
+static const kernel_fn_t KERNEL_SCALAR_TYPES[NUM_TRI_TYPES][2] =
+{
+	{kernel_scalar_t0, kernel_scalar_t0_def},
+	{kernel_scalar_t1, kernel_scalar_t1_def},
+	{kernel_scalar_t2, kernel_scalar_t2_def},
+	{kernel_scalar_t3, kernel_scalar_t3_def},
+	{kernel_scalar_t4, kernel_scalar_t4_def},
+	{kernel_scalar_t5, kernel_scalar_t5_def},
+	{kernel_scalar_t6, kernel_scalar_t6_def},
+	{kernel_scalar_t7, kernel_scalar_t7_def},
+};
+
+
+#ifdef KERNEL_X86
+
+/* Kernel for 8 cells per step using SSE4.1 */
+#define V_TARGET __attribute__((target("sse4.1")))
+#define V_CELLS sse41_cells
+#define V_KERNEL kernel_sse41
+#define V_KERNEL_DEF kernel_sse41_def
+#define V_KERNEL_NOINDEL kernel_sse41_noindel
+#define V_LANES 8
+#define V_T __m128i
+#define V_SET1(x) _mm_set1_epi16(x)
+#define V_ZERO() _mm_setzero_si128()
+#define V_LD16(p) _mm_loadu_si128((const __m128i *) (p))
+#define V_ST16(p, v) _mm_storeu_si128((__m128i *) (p), v)
+#define V_LDB(p) _mm_loadl_epi64((const __m128i *) (p))
+#define V_U8(x) _mm_cvtepu8_epi16(x)
+#define V_LDU8(p) V_U8(V_LDB(p))
+#define V_STU8(p, v) _mm_storel_epi64((__m128i *) (p), _mm_packus_epi16(v, v))
+#define V_LUTS(t, i) _mm_cvtepi8_epi16(_mm_shuffle_epi8(t, i))
+#define V_LUTU(t, i) _mm_cvtepu8_epi16(_mm_shuffle_epi8(t, i))
+#define V_ADD(a, b) _mm_add_epi16(a, b)
+#define V_SUB(a, b) _mm_sub_epi16(a, b)
+#define V_AND(a, b) _mm_and_si128(a, b)
+#define V_OR(a, b) _mm_or_si128(a, b)
+#define V_ANDNOT(a, b) _mm_andnot_si128(a, b)
+#define V_EQ(a, b) _mm_cmpeq_epi16(a, b)
+#define V_GT(a, b) _mm_cmpgt_epi16(a, b)
+#define V_ABS(a) _mm_abs_epi16(a)
+#define V_BLEND(a, b, m) _mm_blendv_epi8(a, b, m)
+#define V_MASK(m) (_mm_movemask_epi8(_mm_packs_epi16(m, _mm_setzero_si128())) & 0xFF)
+#include "kernel_vec.h"
+
+/* Kernel for 16 cells per step using AVX2 */
+#define V_TARGET __attribute__((target("avx2")))
+#define V_CELLS avx2_cells
+#define V_KERNEL kernel_avx2
+#define V_KERNEL_DEF kernel_avx2_def
+#define V_KERNEL_NOINDEL kernel_avx2_noindel
+#define V_LANES 16
+#define V_T __m256i
+#define V_SET1(x) _mm256_set1_epi16(x)
+#define V_ZERO() _mm256_setzero_si256()
+#define V_LD16(p) _mm256_loadu_si256((const __m256i *) (p))
+#define V_ST16(p, v) _mm256_storeu_si256((__m256i *) (p), v)
+#define V_LDB(p) _mm_loadu_si128((const __m128i *) (p))
+#define V_U8(x) _mm256_cvtepu8_epi16(x)
+#define V_LDU8(p) V_U8(V_LDB(p))
+#define V_STU8(p, v) _mm_storeu_si128((__m128i *) (p), _mm_packus_epi16( \
+	_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)))
+#define V_LUTS(t, i) _mm256_cvtepi8_epi16(_mm_shuffle_epi8(t, i))
+#define V_LUTU(t, i) _mm256_cvtepu8_epi16(_mm_shuffle_epi8(t, i))
+#define V_ADD(a, b) _mm256_add_epi16(a, b)
+#define V_SUB(a, b) _mm256_sub_epi16(a, b)
+#define V_AND(a, b) _mm256_and_si256(a, b)
+#define V_OR(a, b) _mm256_or_si256(a, b)
+#define V_ANDNOT(a, b) _mm256_andnot_si256(a, b)
+#define V_EQ(a, b) _mm256_cmpeq_epi16(a, b)
+#define V_GT(a, b) _mm256_cmpgt_epi16(a, b)
+#define V_ABS(a) _mm256_abs_epi16(a)
+#define V_BLEND(a, b, m) _mm256_blendv_epi8(a, b, m)
+#define V_MASK(m) (_mm_movemask_epi8(_mm_packs_epi16( \
+	_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1))) & 0xFFFF)
+#include "kernel_vec.h"
+
+#endif // KERNEL_X86
+
+
+/**
+ * Get maximal change of score by one match or mismatch
+ * @param tri_type Triplex type
+ * @param pen Penalization scores
+ * @return Maximal absolute change
+ */
+static long kernel_max_step(int tri_type, t_penalization *pen)
+{
+	long max_inc = 0, max_step, iso;
+	
+	for (int a = 0; a < NBASES; a++)
+		for (int b = 0; b < NBASES; b++)
+			if (labs(TAB_SCORE[tri_type][a][b]) > max_inc)
+				max_inc = labs(TAB_SCORE[tri_type][a][b]);
+	
+	iso = labs(pen->iso_change) > labs(pen->iso_stay) ? labs(pen->iso_change) : labs(pen->iso_stay);
+	max_step = max_inc + iso;
+	if (labs(pen->mismatch) > max_step)
+		max_step = labs(pen->mismatch);
+	
+	return max_step;
+}
+
+
+/**
+ * Check if indels can never win over match or mismatch
+ * Without indels, a cell of antidiagonal ad is reached by at most
+ * ad/2 + 1 matches or mismatches, so scores are within -B..B for
+ * B = (n_antidiag/2 + 1)*kernel_max_step. The indel is chosen only
+ * if a neighbour minus insertion beats the cell, which is impossible
+ * if insertion >= 2*B. Such search can skip indel transitions.
+ * @param tri_type Triplex type
+ * @param pen Penalization scores
+ * @param n_antidiag Number of antidiagonals per triplex
+ * @return 1 if kernels without indels are safe, 0 otherwise
+ */
+static int kernel_noindel_safe(int tri_type, t_penalization *pen, int n_antidiag)
+{
+	double bound = (double) (n_antidiag/2 + 1) * kernel_max_step(tri_type, pen);
+	
+	return pen->insertion >= 2*bound;
+}
+
+
+/**
+ * Get bound of absolute scores of a search
+ * A score of antidiagonal ad sums at most ad + 2 steps.
+ * @param tri_type Triplex type
+ * @param pen Penalization scores
+ * @param n_antidiag Number of antidiagonals per triplex
+ * @param indel Kernels consider indels, so insertion is a step too
+ * @return Bound of scores
+ */
+static double kernel_score_bound(int tri_type, t_penalization *pen, int n_antidiag, int indel)
+{
+	long max_step = kernel_max_step(tri_type, pen);
+	
+	if (indel && labs(pen->insertion) > max_step)
+		max_step = labs(pen->insertion);
+	
+	return (double) (n_antidiag + 2) * max_step;
+}
+
+
+/**
+ * Check if narrow DP state could overflow
+ * Narrow state holds scores and positions in int16_t and indel counts
+ * in uint8_t, which long triplexes or big penalizations exceed. Wide
+ * state holds all of them in int32_t.
+ * @param tri_type Triplex type
+ * @param pen Penalization scores
+ * @param n_antidiag Number of antidiagonals per triplex
+ * @param indel Kernels consider indels
+ * @return 1 if wide state is needed, 0 otherwise
+ */
+static int kernel_wide(int tri_type, t_penalization *pen, int n_antidiag, int indel)
+{
+	return n_antidiag > DS_MAX_ANTIDIAG || (indel && n_antidiag > UINT8_MAX) ||
+		kernel_score_bound(tri_type, pen, n_antidiag, indel) >= INT16_MAX;
+}
+
+
+/**
+ * Check if 16-bit vector kernels compute the same scores as scalar one
+ * Scores stay in int16_t range if no step can change them by more
+ * than 32767/n_antidiag. Tables must fit into bytes.
+ * @param tri_type Triplex type
+ * @param pen Penalization scores
+ * @param n_antidiag Number of antidiagonals per triplex
+ * @param indel Kernels consider indels, so insertion is a step too
+ * @return 1 if vector kernels are safe, 0 otherwise
+ */
+static int kernel_narrow_safe(int tri_type, t_penalization *pen, int n_antidiag, int indel)
+{
+	for (int a = 0; a < NBASES; a++)
+	{
+		for (int b = 0; b < NBASES; b++)
+		{
+			int score = TAB_SCORE[tri_type][a][b];
+			int group = TAB_GROUP[tri_type][a][b];
+			
+			if (score < INT8_MIN || score > INT8_MAX ||
+			    group < 0 || group > UINT8_MAX)
+				return 0;
+		}
+	}
+	return !kernel_wide(tri_type, pen, n_antidiag, indel);
+}
+
+
+/**
+ * Tabulate isomorphic group changes of a triplex type
+ * Triplet n changes the group after triplets p and t if its group
+ * differs from group of t and its twist differs from twists of both
+ * p and t by more than dtwist, @see get_max_score
+ * @param kern Kernel with the output table
+ * @param tri_type Triplex type
+ * @param dtwist Maximal twist difference within a group
+ */
+static void kernel_iso_fill(t_kernel *kern, int tri_type, int dtwist)
+{
+	for (int p = 0; p < TRIP_N; p++)
+	{
+		int p_twist = (p < NBASES*NBASES) ? TAB_TWIST[tri_type][p/NBASES][p%NBASES] : 90;
+		
+		for (int t = 0; t < TRIP_N; t++)
+		{
+			int t_twist = (t < NBASES*NBASES) ? TAB_TWIST[tri_type][t/NBASES][t%NBASES] : 90;
+			int t_group = (t < NBASES*NBASES) ? TAB_GROUP[tri_type][t/NBASES][t%NBASES] : 0;
+			uint16_t mask = 0;
+			
+			for (int n = 0; n < NBASES*NBASES; n++)
+			{
+				int twist = TAB_TWIST[tri_type][n/NBASES][n%NBASES];
+				
+				if ((TAB_GROUP[tri_type][n/NBASES][n%NBASES] != t_group) &&
+				    (abs(twist - t_twist) > dtwist) && (abs(twist - p_twist) > dtwist))
+					mask |= 1u << n;
+			}
+			kern->iso[p*TRIP_N + t] = mask;
+		}
+	}
+}
+
+
+/**
+ * Select the fastest kernel for given triplex type and parameters
+ * Kernels without indels are preferred if indels can never win,
+ * then kernels with built-in tables or default penalization folded
+ * in, the generic ones handle custom values. Searches which could
+ * overflow narrow DP state get the wide scalar kernel, @see kernel_wide.
+ * @param kern Output kernel
+ * @param tri_type Triplex type
+ * @param pen Penalization scores
+ * @param n_antidiag Number of antidiagonals per triplex
+ * @return 0 on success, -1 if scores could overflow even wide state
+ */
+int kernel_select(t_kernel *kern, int tri_type, t_penalization *pen, int n_antidiag)
+{
+	int def_tables = 1;
+	int def_pen = (pen->dtwist == PEN_DTWIST && pen->insertion == PEN_INSERTION &&
+		pen->iso_change == PEN_ISO_CHANGE && pen->iso_stay == PEN_ISO_STAY &&
+		pen->mismatch == PEN_MISMATCH);
+	int noindel = kernel_noindel_safe(tri_type, pen, n_antidiag);
+	
+	for (int a = 0; a < NBASES; a++)
+	{
+		for (int b = 0; b < NBASES; b++)
+		{
+			kern->score[a*NBASES+b] = TAB_SCORE[tri_type][a][b];
+			kern->group[a*NBASES+b] = TAB_GROUP[tri_type][a][b];
+			kern->twist[a*NBASES+b] = TAB_TWIST[tri_type][a][b] - 90;
+			if (TAB_SCORE[tri_type][a][b] != KERN_SCORE[tri_type][a*NBASES+b])
+				def_tables = 0;
+		}
+	}
+	kernel_iso_fill(kern, tri_type, pen->dtwist);
+	
+	kern->wide = kernel_wide(tri_type, pen, n_antidiag, !noindel);
+	if (kern->wide)
+	{
+		kern->step = noindel ? kernel_scalar_wide_noindel : kernel_scalar_wide;
+		return (kernel_score_bound(tri_type, pen, n_antidiag, !noindel) < INT32_MAX) ? 0 : -1;
+	}
+	
+	if (noindel)
+		kern->step = kernel_scalar_noindel;
+	else if (def_tables)
+		kern->step = KERNEL_SCALAR_TYPES[tri_type][def_pen];
+	else
+		kern->step = def_pen ? kernel_scalar_def : kernel_scalar;
+	
+	if (!kernel_narrow_safe(tri_type, pen, n_antidiag, !noindel))
+		return 0;
+
+#ifdef KERNEL_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		kern->step = noindel ? kernel_avx2_noindel : (def_pen ? kernel_avx2_def : kernel_avx2);
+	else if (__builtin_cpu_supports("sse4.1"))
+		kern->step = noindel ? kernel_sse41_noindel : (def_pen ? kernel_sse41_def : kernel_sse41);
+#endif
+	return 0;
+}
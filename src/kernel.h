@@ -0,0 +1,141 @@
+/**
+ * Triplex package
+ * Header file for antidiagonal search kernels
+ *
+ * @file    kernel.h
+ * @package triplex
+ */
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <stdint.h>
+
+#include "libtriplex.h"
+#include "dl_list.h"
+
+/* Define to build the scalar kernel only */
+// #define TRIPLEX_NO_SIMD
+
+/* Status variable flags */
+#define STAT_NONE     0
+#define STAT_QUALITY  1
+#define STAT_MINLEN   2
+#define STAT_EXPORT   4
+
+/* Status and DP rule share one byte of t_dstate.flags */
+#define FL_STATUS     0x07
+#define FL_RULE_SHIFT 3
+#define FL_RULE(f)    ((f) >> FL_RULE_SHIFT)
+
+/* Maximal number of antidiagonals, positions are stored as int16_t
+ * in narrow DP state and as int32_t in wide one */
+#define DS_MAX_ANTIDIAG      INT16_MAX
+#define DS_MAX_ANTIDIAG_WIDE (1 << 20)
+
+/* Triplets are stored as index a*4+b, TRIP_NONE stands for the state
+ * before the first match with group 0 and twist 90. Bit 7 makes byte
+ * shuffles return 0 for it, TRIP_IDX maps it to the last table entry. */
+#define TRIP_N        (NBASES*NBASES + 1)
+#define TRIP_NONE     0x90
+#define TRIP_IDX(t)   ((t) & 0x1F)
+
+typedef struct
+{// DP state of piece diagonals as structure of arrays
+ // Every array is split into two planes by diagonal parity, so cells
+ // of one antidiagonal and their neighbours are stored contiguously,
+ // see DS_IDX. Fields have the same meaning as in t_diag, only diagonal
+ // positions are stored relative to the diagonal of the cell.
+ // Scores, positions and indel counts of wide state are stored in the
+ // arrays of w instead, @see kernel_wide.
+	int half;                 /* Size of one plane */
+	int wide;                 /* Wide state, narrow arrays are NULL */
+	int16_t *score;           /* Actual score */
+	int16_t *max_score;       /* Maximal score */
+	int16_t *start_diag;      /* Position of the first match */
+	int16_t *start_antidiag;
+	int16_t *max_diag;        /* Maximal score position */
+	int16_t *max_antidiag;
+	uint8_t *trip;            /* Last matched triplet */
+	uint8_t *ptrip;           /* Triplet matched before the last one */
+	uint8_t *flags;           /* Status and previous position (DP rule) */
+	uint8_t *indels;          /* Number of indels */
+	uint8_t *max_indels;      /* Number of indels to max score position */
+	struct
+	{// Wide fields, NULL in narrow state
+		int32_t *score;
+		int32_t *max_score;
+		int32_t *start_diag;
+		int32_t *start_antidiag;
+		int32_t *max_diag;
+		int32_t *max_antidiag;
+		int32_t *indels;
+		int32_t *max_indels;
+	} w;
+} t_dstate;
+
+/* Index of diagonal d in t_dstate arrays */
+#define DS_IDX(ds, d) (((d) & 1)*(ds)->half + ((d) >> 1))
+
+/* Field f of t_dstate at index k in narrow or wide state */
+#define DS_GET(ds, f, k) ((ds)->wide ? (ds)->w.f[k] : (ds)->f[k])
+
+/* Bytes of t_dstate arrays per diagonal */
+#define DS_DIAG_SIZE      (6*sizeof(int16_t) + 5*sizeof(uint8_t))
+#define DS_WIDE_DIAG_SIZE (8*sizeof(int32_t) + 3*sizeof(uint8_t))
+
+typedef struct
+{// P-values of scores of one triplex type, @see pvalue_table in search.c
+	double lambda, mi, rn;  /* Constants the table was built for */
+	int64_t seq_len;        /* Sequence length the table was built for */
+	int size;               /* Number of scores in the table */
+	double *p;              /* P-values of scores 0..size-1 */
+} t_pvalue;
+
+typedef struct t_kctx t_kctx;
+
+/* Compute cells of antidiagonal ad in rows first..last,
+ * returns number of cells under the pruning treshold */
+typedef int (*kernel_fn_t)(t_kctx *ctx, int ad, int first, int last);
+
+typedef struct
+{// Kernel selected for one triplex type
+	kernel_fn_t step;
+	int wide;           /* Kernel needs wide DP state */
+	int8_t score[16];   /* TAB_SCORE of the type indexed by a*4+b */
+	uint8_t group[16];  /* TAB_GROUP of the type indexed by a*4+b */
+	int8_t twist[16];   /* TAB_TWIST of the type minus 90 indexed by a*4+b */
+	/* Isomorphic group change for triplets ptrip, trip and a*4+b is
+	 * bit a*4+b of iso[TRIP_IDX(ptrip)*TRIP_N + TRIP_IDX(trip)] */
+	uint16_t iso[TRIP_N*TRIP_N];
+} t_kernel;
+
+struct t_kctx
+{// Search context of one piece
+	const char *piece;    /* Encoded piece sequence */
+	int first_row;        /* Rows where triplexes can not continue, -1 if none */
+	int last_row;
+	int64_t offset;       /* Offset of the piece in sequence */
+	const t_pvalue *pv;   /* P-values of scores */
+	int treshold;         /* Pruning treshold of the actual antidiagonal */
+	t_params *params;
+	t_penalization *pen;
+	const t_kernel *kern;
+	t_dstate *ds;
+	t_dl_buf *buf;
+};
+
+size_t dstate_size(int n, int wide);
+void dstate_init(t_dstate *ds, void *mem, int n, int wide);
+void dstate_reset(t_dstate *ds, int n, int min_loop);
+void dstate_shift(t_dstate *ds, int first, int last, int shift, int n, int min_loop);
+int dstate_find(const t_dstate *ds, int first, int last, int treshold, int over);
+int scores_find(const t_dstate *ds, int k, int count, int treshold);
+
+int kernel_select(t_kernel *kern, int tri_type, t_penalization *pen, int n_antidiag);
+int kernel_scalar(t_kctx *ctx, int ad, int first, int last);
+
+/* Export diagonal d if it satisfies P-value, @see search.c */
+void export_diag(t_kctx *ctx, int d);
+
+#endif // KERNEL_H
@@ -0,0 +1,295 @@
+/**
+ * Triplex package
+ * Vector antidiagonal kernel, included by kernel.c once per instruction set
+ *
+ * Computes V_LANES cells of one antidiagonal per step in 16-bit lanes.
+ * The rules are the same as in kernel_scalar, only exports are done
+ * one by one in diagonal order after the step. Fields copied from
+ * neighbours and positions are loaded and stored only if some lane
+ * needs them. Must be used only if kernel_narrow_safe holds.
+ * Defines V_KERNEL for penalization of the context, V_KERNEL_DEF
+ * with default penalization folded in and V_KERNEL_NOINDEL without
+ * indel transitions, if kernel_noindel_safe holds.
+ *
+ * @file    kernel_vec.h
+ * @package triplex
+ */
+
+V_TARGET KERNEL_INLINE int V_CELLS(
+	t_kctx *c, int ad, int first, int last, int def_pen, int use_indel)
+{
+	t_dstate *ds = c->ds;
+	t_params *params = c->params;
+	t_penalization *p = c->pen;
+	const char *piece = c->piece;
+	int under = 0, i;
+	
+	int kc = ((ad + 1) & 1)*ds->half - (ad >> 1);
+	int kn = (ad & 1)*ds->half - (ad >> 1) - (ad & 1);
+	
+	/* Out of range constants are clamped, scores are in int16_t range */
+	int min_score = params->min_score;
+	min_score = (min_score < INT16_MIN) ? INT16_MIN : (min_score > INT16_MAX) ? INT16_MAX : min_score;
+	int treshold = c->treshold;
+	treshold = (treshold < INT16_MIN) ? INT16_MIN : (treshold > INT16_MAX) ? INT16_MAX : treshold;
+	int dtwist = def_pen ? PEN_DTWIST : p->dtwist;
+	int insertion = def_pen ? PEN_INSERTION : p->insertion;
+	int iso_change = def_pen ? PEN_ISO_CHANGE : p->iso_change;
+	int iso_stay = def_pen ? PEN_ISO_STAY : p->iso_stay;
+	int mismatch = def_pen ? PEN_MISMATCH : p->mismatch;
+	dtwist = (dtwist < -1) ? -1 : (dtwist > 1024) ? 1024 : dtwist;
+	/* length >= min_len <=> max_ad - start_ad - max_indels > min_diff,
+	 * see get_length */
+	long long min_diff = (long long) params->min_len - 1;
+	min_diff = (min_diff > 0) ? 2*min_diff - 1 : 2*min_diff - 2;
+	min_diff = (min_diff < INT16_MIN) ? INT16_MIN : (min_diff > INT16_MAX) ? INT16_MAX : min_diff;
+	int reset = (ad <= params->max_loop);
+	/* Row of the cell pairing the first row, @see t_kctx */
+	int first_row = (c->first_row >= 0) ? ad + c->first_row : -1;
+	
+	const __m128i t_score = _mm_loadu_si128((const __m128i *) c->kern->score);
+	const __m128i t_group = _mm_loadu_si128((const __m128i *) c->kern->group);
+	const __m128i t_twist = _mm_loadu_si128((const __m128i *) c->kern->twist);
+	const V_T v_tm = V_SET1(TM);
+	const V_T v_rule = V_SET1(0xFF & ~FL_STATUS);
+	const V_T v_match = V_SET1(DP_MATCH << FL_RULE_SHIFT);
+	const V_T v_mismatch = V_SET1(DP_MISMATCH << FL_RULE_SHIFT);
+	const V_T v_left = V_SET1(DP_LEFT << FL_RULE_SHIFT);
+	const V_T v_right = V_SET1(DP_RIGHT << FL_RULE_SHIFT);
+	const V_T v_dtwist = V_SET1(dtwist);
+	const V_T v_iso_change = V_SET1(-iso_change);
+	const V_T v_iso_stay = V_SET1(iso_stay);
+	const V_T v_mis_pen = V_SET1(-mismatch);
+	const V_T v_ins_pen = V_SET1(insertion);
+	const V_T v_min_score = V_SET1(min_score);
+	const V_T v_treshold = V_SET1(treshold);
+	const V_T v_min_diff = V_SET1(min_diff);
+	const V_T v_ad = V_SET1(ad);
+	const V_T v_one = V_SET1(1);
+	const V_T v_byte = V_SET1(0xFF);
+	const V_T v_quality = V_SET1(STAT_QUALITY);
+	const V_T v_minlen = V_SET1(STAT_MINLEN);
+	const V_T v_export = V_SET1(STAT_EXPORT);
+	const V_T v_zero = V_ZERO();
+	const V_T v_ones = V_EQ(v_zero, v_zero);
+	
+	for (i = first; i + V_LANES - 1 <= last; i += V_LANES)
+	{
+		int k = kc + i, l = kn + i, r = kn + i + 1;
+		int d = 2*i - ad + 1;
+		
+		/* Triplet table lookups indexed by a*4+b */
+		__m128i idx = _mm_or_si128(_mm_slli_epi16(V_LDB(piece + i), 2), V_LDB(piece + i - ad));
+		V_T inc = V_LUTS(t_score, idx);
+		V_T grp = V_LUTU(t_group, idx);
+		V_T tws = V_LUTS(t_twist, idx);
+		
+		/* Group and twists of previous triplets, zero for TRIP_NONE */
+		__m128i trip_b = V_LDB(ds->trip + k);
+		__m128i ptrip_b = V_LDB(ds->ptrip + k);
+		V_T trip = V_U8(trip_b);
+		V_T ptrip = V_U8(ptrip_b);
+		V_T bound = V_LUTU(t_group, trip_b);
+		V_T twist_diff = V_SUB(tws, V_LUTS(t_twist, trip_b));
+		V_T ptwist_diff = V_SUB(tws, V_LUTS(t_twist, ptrip_b));
+		
+		V_T score = V_LD16(ds->score + k);
+		V_T max_score = V_LD16(ds->max_score + k);
+		V_T flags = V_LDU8(ds->flags + k);
+		V_T indels = V_LDU8(ds->indels + k);
+		V_T max_indels = V_LDU8(ds->max_indels + k);
+		V_T l_flags = V_LDU8(ds->flags + l);
+		V_T r_flags = V_LDU8(ds->flags + r);
+		
+		/* Match or mismatch score */
+		V_T match = V_GT(inc, v_tm);
+		V_T iso_check = V_AND(match, V_EQ(V_AND(flags, v_rule), v_match));
+		V_T change = V_ANDNOT(V_EQ(grp, bound), V_AND(
+			V_GT(V_ABS(twist_diff), v_dtwist),
+			V_GT(V_ABS(ptwist_diff), v_dtwist)));
+		V_T iso = (iso_stay == 0) ?
+			V_AND(V_AND(iso_check, change), v_iso_change) :
+			V_AND(iso_check, V_BLEND(v_iso_stay, v_iso_change, change));
+		V_T mm = V_ADD(score, V_BLEND(v_mis_pen, V_ADD(inc, iso), match));
+		
+		/* Decision between match/mismatch and indel */
+		V_T l_ins = v_zero, r_ins = v_zero, indel = v_zero, left = v_zero;
+		if (use_indel)
+		{
+			V_T l_score = V_LD16(ds->score + l);
+			V_T r_score = V_LD16(ds->score + r);
+			
+			l_ins = V_SUB(l_score, v_ins_pen);
+			r_ins = V_SUB(r_score, v_ins_pen);
+			indel = V_OR(V_GT(l_ins, mm), V_GT(r_ins, mm));
+			left = V_AND(indel, V_GT(l_score, r_score));
+		}
+		V_T upd = V_ANDNOT(V_OR(indel, V_GT(max_score, mm)), match);
+		V_T rule = V_BLEND(v_mismatch, v_match, match);
+		
+		/* Match/mismatch fields */
+		ptrip = V_BLEND(ptrip, trip, match);
+		trip = V_BLEND(trip, V_U8(idx), match);
+		max_score = V_BLEND(max_score, mm, upd);
+		max_indels = V_BLEND(max_indels, indels, upd);
+		score = mm;
+		
+		V_T start_diag = v_zero, start_ad = v_zero, max_diag = v_zero, max_ad = v_zero;
+		unsigned int pos_mask = V_MASK(V_OR(indel, upd));
+		
+		if (pos_mask || reset)
+		{
+			start_diag = V_LD16(ds->start_diag + k);
+			start_ad = V_LD16(ds->start_antidiag + k);
+			max_diag = V_BLEND(V_LD16(ds->max_diag + k), v_zero, upd);
+			max_ad = V_BLEND(V_LD16(ds->max_antidiag + k), v_ad, upd);
+		}
+		
+		if (use_indel && V_MASK(indel))
+		{// Fields copied from left or right diagonal
+#define V_FROM(dst, ld, arr) \
+			dst = V_BLEND(dst, V_BLEND(ld(arr + r), ld(arr + l), left), indel)
+#define V_FROM_DIAG(dst, arr) \
+			dst = V_BLEND(dst, V_BLEND(V_ADD(V_LD16(arr + r), v_one), \
+			                           V_SUB(V_LD16(arr + l), v_one), left), indel)
+			V_FROM(max_score, V_LD16, ds->max_score);
+			V_FROM(trip, V_LDU8, ds->trip);
+			V_FROM(ptrip, V_LDU8, ds->ptrip);
+			V_FROM(indels, V_LDU8, ds->indels);
+			V_FROM(max_indels, V_LDU8, ds->max_indels);
+			V_FROM(start_ad, V_LD16, ds->start_antidiag);
+			V_FROM(max_ad, V_LD16, ds->max_antidiag);
+			V_FROM_DIAG(start_diag, ds->start_diag);
+			V_FROM_DIAG(max_diag, ds->max_diag);
+#undef V_FROM
+#undef V_FROM_DIAG
+			flags = V_BLEND(flags, V_BLEND(r_flags, l_flags, left), indel);
+			score = V_BLEND(score, V_BLEND(r_ins, l_ins, left), indel);
+			rule = V_BLEND(rule, V_BLEND(v_right, v_left, left), indel);
+			indels = V_AND(V_ADD(indels, V_AND(indel, v_one)), v_byte);
+		}
+		
+		if (reset)
+		{// Local alignment only for loop
+			V_T neg = V_GT(v_zero, score);
+			
+			score = V_ANDNOT(neg, score);
+			max_score = V_ANDNOT(neg, max_score);
+			indels = V_ANDNOT(neg, indels);
+			max_indels = V_ANDNOT(neg, max_indels);
+			start_diag = V_ANDNOT(neg, start_diag);
+			max_diag = V_ANDNOT(neg, max_diag);
+			start_ad = V_BLEND(start_ad, v_ad, neg);
+			max_ad = V_BLEND(max_ad, v_ad, neg);
+			pos_mask |= V_MASK(neg);
+		}
+		
+		/* Triplex length satisfies min_len, both antidiagonals
+		 * are untouched if no lane needed positions */
+		V_T minlen;
+		if (pos_mask || reset)
+			minlen = V_GT(V_SUB(V_SUB(max_ad, start_ad), max_indels), v_min_diff);
+		else
+			minlen = V_GT(V_SUB(V_SUB(V_LD16(ds->max_antidiag + k), V_LD16(ds->start_antidiag + k)), max_indels), v_min_diff);
+		
+		V_T status = V_ANDNOT(v_rule, flags);
+		status = V_BLEND(V_ANDNOT(v_minlen, status), V_OR(status, v_minlen), minlen);
+		
+		/* Quality cells get quality flag, the others lose their status
+		 * unless the triplex ends here */
+		V_T quality = (min_score == INT16_MIN) ? v_ones : V_GT(score, V_SUB(v_min_score, v_one));
+		V_T neigh = V_OR(l_flags, r_flags);
+		V_T finished = V_ANDNOT(quality, V_AND(
+			V_EQ(V_AND(neigh, v_quality), v_zero),
+			V_AND(V_EQ(V_AND(status, v_quality), v_quality), V_EQ(V_AND(status, v_minlen), v_minlen))));
+		V_T on_edge = V_AND(quality, V_EQ(V_AND(status, v_minlen), v_minlen));
+		status = V_BLEND(V_AND(finished, v_export), V_OR(status, v_quality), quality);
+		
+		under += __builtin_popcount(V_MASK(V_GT(v_treshold, score)));
+		
+		V_ST16(ds->score + k, score);
+		V_ST16(ds->max_score + k, max_score);
+		V_STU8(ds->trip + k, trip);
+		V_STU8(ds->ptrip + k, ptrip);
+		V_STU8(ds->flags + k, V_OR(status, rule));
+		V_STU8(ds->indels + k, indels);
+		V_STU8(ds->max_indels + k, max_indels);
+		if (pos_mask)
+		{
+			V_ST16(ds->start_diag + k, start_diag);
+			V_ST16(ds->start_antidiag + k, start_ad);
+			V_ST16(ds->max_diag + k, max_diag);
+			V_ST16(ds->max_antidiag + k, max_ad);
+		}
+		
+		/* Triplex can not continue on the first and the last row */
+		unsigned int edge = 0;
+		if (first_row >= i && first_row < i + V_LANES)
+			edge |= 1u << (first_row - i);
+		if (c->last_row >= i && c->last_row < i + V_LANES)
+			edge |= 1u << (c->last_row - i);
+		
+		unsigned int fin = V_MASK(finished);
+		unsigned int todo = fin | (V_MASK(on_edge) & edge);
+		
+		while (todo)
+		{// Exports in diagonal order
+			int j = __builtin_ctz(todo);
+			todo &= todo - 1;
+			
+			ds->flags[k + j] = STAT_EXPORT | (ds->flags[k + j] & ~FL_STATUS);
+			export_diag(c, d + 2*j);
+			if (fin & (1u << j))
+				ds->max_score[k + j] = 0;
+		}
+	}
+	
+	if (i <= last)
+		under += !use_indel ? kernel_scalar_noindel(c, ad, i, last) :
+			def_pen ? kernel_scalar_def(c, ad, i, last) : kernel_scalar(c, ad, i, last);
+	
+	return under;
+}
+
+V_TARGET static int V_KERNEL(t_kctx *c, int ad, int first, int last)
+{
+	return V_CELLS(c, ad, first, last, 0, 1);
+}
+
+V_TARGET static int V_KERNEL_DEF(t_kctx *c, int ad, int first, int last)
+{
+	return V_CELLS(c, ad, first, last, 1, 1);
+}
+
+V_TARGET static int V_KERNEL_NOINDEL(t_kctx *c, int ad, int first, int last)
+{
+	return V_CELLS(c, ad, first, last, 0, 0);
+}
+
+#undef V_TARGET
+#undef V_CELLS
+#undef V_KERNEL
+#undef V_KERNEL_DEF
+#undef V_KERNEL_NOINDEL
+#undef V_LANES
+#undef V_T
+#undef V_SET1
+#undef V_ZERO
+#undef V_LD16
+#undef V_ST16
+#undef V_LDB
+#undef V_U8
+#undef V_LDU8
+#undef V_STU8
+#undef V_LUTS
+#undef V_LUTU
+#undef V_ADD
+#undef V_SUB
+#undef V_AND
+#undef V_OR
+#undef V_ANDNOT
+#undef V_EQ
+#undef V_GT
+#undef V_ABS
+#undef V_BLEND
+#undef V_MASK
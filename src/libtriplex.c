@@ -16,6 +16,11 @@
 #include <ctype.h>
 #include "libtriplex.h"
 
+#if !defined(TRIPLEX_NO_SIMD) && defined(__GNUC__) && defined(__SSE2__)
+#define SEQ_SSE2
+#include <emmintrin.h>
+#endif
+
 
 /* Translation table from ascii symbols to
  * internal representation of DNA bases */
@@ -37,15 +42,6 @@ const int COMP[NBASES] =
 	[G] = C, [T] = A 
 };
 
-/* Table indicating which symbols should be cut off
- * from input DNA sequence, especially IUPAC symbols */
-const int CHUNKCHAR[ASCII_LOW] =
-{
-	['n'] = 1, ['-'] = 1, ['r'] = 1, ['m'] = 1,
-	['w'] = 1, ['d'] = 1, ['v'] = 1, ['h'] = 1,
-	['b'] = 1, ['s'] = 1, ['y'] = 1, ['k'] = 1
-};
-
 
 /* Possible triplex types
 ---------------------------------------------------
@@ -130,8 +126,6 @@ Score Matrix:    column            row
 #define TS 2
 // Alternative (weak) triplet score
 #define TW 1
-// Triplet missmatch indication
-#define TM -9
 
 int TAB_SCORE[NUM_TRI_TYPES][NBASES][NBASES] =
 {// Tabulated triplet score
@@ -327,14 +321,6 @@ const int TAB_TWIST[NUM_TRI_TYPES][NBASES][NBASES] =
 };
 
 
-typedef enum
-{// States for chunk analysis
-	S_CHUNK_INIT,
-	S_CHUNK_IN,
-	S_CHUNK_OUT
-} ch_state_t;
-
-
 /**
  * Get maximal bonus per diagonal step
  * @param type Triplex type
@@ -438,7 +424,7 @@ void init_CHAR2NUKL_table()
 void encode_bases(seq_t dna)
 {
 	char ch;
-	for (int i = 0; i < dna.len; i++)
+	for (int64_t i = 0; i < dna.len; i++)
 	{
 		ch = CHAR2NUKL[tolower(dna.seq[i])];
 		if (ch == INVALID_CHAR)
@@ -449,55 +435,224 @@ void encode_bases(seq_t dna)
 }
 #endif
 
+/**
+ * Initialize encoded sequence over source symbols
+ * The source is read in place, it must outlive the sequence.
+ * @param dna Encoded sequence
+ * @param raw Source symbols
+ * @param code Code of every source symbol as in CHAR2NUKL, 256 items
+ * @param len Sequence length
+ * @param type Sequence type
+ */
+void seq_init(seq_t *dna, const void *raw, const char *code, int64_t len, int type)
+{
+	dna->raw = raw;
+	dna->code = code;
+	dna->len = len;
+	dna->type = type;
+	dna->run = NULL;
+	dna->nruns = 0;
+	dna->size = 0;
+	
+	int n = 0;
+	for (int b = 0; b <= UINT8_MAX; b++)
+	{// Source symbols of bases for vector compares
+		if (code[b] < 0 || code[b] >= NBASES)
+			continue;
+		if (n < NBASES)
+			dna->base_raw[n] = b;
+		n++;
+	}
+	dna->nbase_raw = (n == NBASES) ? n : 0;
+}
+
+
+#ifdef SEQ_SSE2
+/**
+ * Skip bases and the continuation of the last run 16 symbols at once
+ * @param dna Encoded sequence
+ * @param i Position
+ * @return First position of a block, which needs a symbol by symbol scan
+ */
+static int64_t seq_skip(seq_t *dna, int64_t i)
+{
+	const uint8_t *raw = dna->raw;
+	
+	if (dna->nruns > 0 && dna->run[dna->nruns-1].end == i - 1)
+	{// Long runs of N are common in assemblies
+		__m128i sym = _mm_set1_epi8(raw[i-1]);
+		
+		for (; i + 16 <= dna->len; i += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *) (raw + i));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, sym)) != 0xFFFF)
+				break;
+			
+			dna->run[dna->nruns-1].end = i + 15;
+		}
+		return i;
+	}
+	
+	if (dna->nbase_raw == 0)
+		return i;
+	
+	__m128i b0 = _mm_set1_epi8(dna->base_raw[0]), b1 = _mm_set1_epi8(dna->base_raw[1]);
+	__m128i b2 = _mm_set1_epi8(dna->base_raw[2]), b3 = _mm_set1_epi8(dna->base_raw[3]);
+	
+	for (; i + 16 <= dna->len; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *) (raw + i));
+		__m128i base = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, b0), _mm_cmpeq_epi8(v, b1)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, b2), _mm_cmpeq_epi8(v, b3))
+		);
+		if (_mm_movemask_epi8(base) != 0xFFFF)
+			break;
+	}
+	return i;
+}
+#endif
+
+
+/**
+ * Find runs of N, - and IUPAC symbols of encoded sequence
+ * Blocks of bases and of one symbol are skipped with SSE2 compares,
+ * other blocks are scanned symbol by symbol.
+ * @param dna Encoded sequence
+ * @param bad Output position of an unsupported symbol
+ * @return 0 on success, 1 on unsupported symbol, -1 if out of memory
+ */
+int seq_scan(seq_t *dna, int64_t *bad)
+{
+	int64_t i = 0;
+	
+	while (i < dna->len)
+	{
+#ifdef SEQ_SSE2
+		i = seq_skip(dna, i);
+		
+		for (int64_t stop = (i + 16 < dna->len) ? i + 16 : dna->len; i < stop; i++)
+#else
+		for (; i < dna->len; i++)
+#endif
+		{
+			char ch = dna->code[dna->raw[i]];
+			
+			if (ch >= 0 && ch < NBASES)
+				continue;
+			if (ch == INVALID_CHAR)
+			{
+				*bad = i;
+				return 1;
+			}
+			if (dna->nruns > 0 && dna->run[dna->nruns-1].end == i - 1 && dna->run[dna->nruns-1].symbol == ch)
+			{// Extend the last run
+				dna->run[dna->nruns-1].end = i;
+				continue;
+			}
+			if (dna->nruns == dna->size)
+			{// Grow run array
+				int64_t size = (dna->size > 0) ? 2*dna->size : 64;
+				t_run *run = realloc(dna->run, (size_t) size * sizeof(t_run));
+				if (run == NULL)
+					return -1;
+				
+				dna->run = run;
+				dna->size = size;
+			}
+			dna->run[dna->nruns++] = (t_run) {i, i, ch};
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * Decode part of encoded sequence to one code per byte
+ * Blocks of bases are decoded 16 at once with SSE2 compares.
+ * @param dna Encoded sequence
+ * @param start First position
+ * @param len Number of symbols
+ * @param out Output codes as in CHAR2NUKL
+ */
+void seq_decode(const seq_t *dna, int64_t start, int64_t len, char *out)
+{
+	const uint8_t *raw = dna->raw + start;
+	int64_t i = 0;
+	
+#ifdef SEQ_SSE2
+	if (dna->nbase_raw > 0)
+	{
+		__m128i b[NBASES], c[NBASES];
+		for (int k = 0; k < NBASES; k++)
+		{
+			b[k] = _mm_set1_epi8(dna->base_raw[k]);
+			c[k] = _mm_set1_epi8(dna->code[dna->base_raw[k]]);
+		}
+		
+		for (; i + 16 <= len; i += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *) (raw + i));
+			__m128i e0 = _mm_cmpeq_epi8(v, b[0]), e1 = _mm_cmpeq_epi8(v, b[1]);
+			__m128i e2 = _mm_cmpeq_epi8(v, b[2]), e3 = _mm_cmpeq_epi8(v, b[3]);
+			
+			if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(e0, e1), _mm_or_si128(e2, e3))) != 0xFFFF)
+			{// Block with other symbols
+				for (int k = 0; k < 16; k++)
+					out[i+k] = dna->code[raw[i+k]];
+				continue;
+			}
+			
+			__m128i res = _mm_or_si128(
+				_mm_or_si128(_mm_and_si128(e0, c[0]), _mm_and_si128(e1, c[1])),
+				_mm_or_si128(_mm_and_si128(e2, c[2]), _mm_and_si128(e3, c[3]))
+			);
+			_mm_storeu_si128((__m128i *) (out + i), res);
+		}
+	}
+#endif
+	for (; i < len; i++)
+		out[i] = dna->code[raw[i]];
+}
+
+
+/**
+ * Free runs of encoded sequence, the source stays
+ * @param dna Encoded sequence
+ */
+void seq_free(seq_t *dna)
+{
+	free(dna->run);
+	dna->run = NULL;
+	dna->nruns = 0;
+	dna->size = 0;
+}
+
+
 /**
  * Get chunk intervals without N or - symbols
- * NOTE This function does well only on encoded DNA sequence
- * @param dna encoded DNA sequence @see encode_bases
+ * Chunks are the gaps between runs of N, - and IUPAC symbols.
+ * @param dna Encoded DNA sequence
  * @return Intervals without N or - symbols
  */
 intv_t *get_chunks(seq_t dna)
 {
-	int i, offset = 0;
-	ch_state_t state = S_CHUNK_INIT;
+	int64_t offset = 0;
 	
 	// Create first interval as a list header
 	intv_t header = {0, 0, NULL};
 	intv_t *last = &header;
 	
-	for (i = 0; i < dna.len; i++)
+	for (int64_t r = 0; r <= dna.nruns; r++)
 	{
-		switch (state)
-		{
-			case S_CHUNK_INIT:
-			// Initial decision
-				if (CHUNKCHAR[(int) dna.seq[i]])
-					state = S_CHUNK_OUT;
-				else
-					state = S_CHUNK_IN;
-				break;
-			case S_CHUNK_IN:
-			// Chunk body
-				if (CHUNKCHAR[(int) dna.seq[i]])
-				{// Export chunk
-					last->next = new_intv(offset, i-1);
-					last = last->next;
-					state = S_CHUNK_OUT;
-				}
-				break;
-			case S_CHUNK_OUT:
-			// Gap between chunks (N or - symbols)
-				if (!CHUNKCHAR[(int) dna.seq[i]])
-				{// Move offset
-					offset = i;
-					state = S_CHUNK_IN;
-				}
-				break;
+		int64_t end = (r < dna.nruns) ? dna.run[r].start : dna.len;
+		if (end > offset)
+		{// Export chunk before the run
+			last->next = new_intv(offset, end - 1);
+			last = last->next;
 		}
-	}
-	if (state == S_CHUNK_IN)
-	{// Export last chunk
-		last->next = new_intv(offset, i-1);
-		last = last->next;
+		if (r < dna.nruns)
+			offset = dna.run[r].end + 1;
 	}
 	return header.next;
 }
@@ -41,6 +41,9 @@
 
 #define INVALID_CHAR -1
 
+// Triplet missmatch indication
+#define TM -9
+
 typedef enum
 {// Enumeration for sequence types
 	ST_PR = 0,
@@ -72,6 +75,11 @@ typedef struct
 	int max_len;
 	int min_loop;
 	int max_loop;
+	int stream;     /* Hand DP state over between pieces, @see main_search */
+	int seed_len;   /* Length of mirror k-mer seeds or 0, @see get_seed_chunks */
+	int trace;      /* Print decisions of the pruning controller, @see search */
+	int prefilter;  /* Cut out parts unable to hold a triplex, @see get_tract_chunks */
+	int seed_band;  /* Search seeds only around their loop lengths, @see get_seed_chunks */
 } t_params;
 
 typedef struct
@@ -84,26 +92,43 @@ typedef struct
 	int8_t dtwist;        /* Change in angle between subsequent triplets */
 	uint8_t status;       /* Status */
 	
-	int16_t score;        /* Actual score */
-	int16_t max_score;    /* Maximal score */
+	int32_t score;        /* Actual score */
+	int32_t max_score;    /* Maximal score */
 
 	uint8_t dp_rule;      /* Previous position: 0 - match, 1 - mismatch, 2 - left, 3 - right  */
-	uint8_t indels;       /* number of indels */
-	uint8_t max_indels;   /* number of indels from start position to max score postition */
+	uint16_t indels;      /* number of indels */
+	uint16_t max_indels;  /* number of indels from start position to max score postition */
 } t_diag;
 
 
 typedef struct
-{// Structure for decoded sequence
-	char *seq;
-	int len;
+{// Run of one N, - or IUPAC symbol in a sequence
+	int64_t start;
+	int64_t end;
+	char symbol;
+} t_run;
+
+typedef struct
+{// Structure for encoded sequence
+	const uint8_t *raw; /* Source symbols, e.g. XRaw bytes, not copied */
+	const char *code;   /* Code of every source symbol as in CHAR2NUKL */
+	int nbase_raw;      /* Source symbols of bases, 0 if not one per base */
+	uint8_t base_raw[NBASES];
+	int64_t len;        /* Sequence length, may exceed 2^31 */
 	int type;
+	t_run *run;         /* Runs of symbols other than bases in sequence order */
+	int64_t nruns;      /* Number of runs */
+	int64_t size;       /* Allocated runs */
 } seq_t;
 
+/* Base A,C,G,T at position i of a chunk of an encoded sequence */
+#define SEQ_BASE(dna, i) ((uint8_t) (dna).code[(dna).raw[i]])
+
 extern char CHAR2NUKL[];
 extern const char NUKL2CHAR[];
 extern int TAB_SCORE[NUM_TRI_TYPES][NBASES][NBASES];
 extern int TAB_GROUP[NUM_TRI_TYPES][NBASES][NBASES];
+extern const int TAB_TWIST[NUM_TRI_TYPES][NBASES][NBASES];
 extern const int COMP[NBASES];
 
 void init_CHAR2NUKL_table();
@@ -111,6 +136,11 @@ void init_CHAR2NUKL_table();
 /* Convert ASCII characters to DNA nukleotide (A=0,C=1,G=2,T=3) */
 void encode_bases(seq_t dna);
 
+void seq_init(seq_t *dna, const void *raw, const char *code, int64_t len, int type);
+int seq_scan(seq_t *dna, int64_t *bad);
+void seq_decode(const seq_t *dna, int64_t start, int64_t len, char *out);
+void seq_free(seq_t *dna);
+
 /* Get chunk intervals without N or - symbols */
 intv_t *get_chunks(seq_t dna);
 
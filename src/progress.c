@@ -12,12 +12,18 @@
 #include <Rinternals.h>
 #include <Rmath.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "progress.h"
 
 #define PB_EXTRA_CHARS 10
 
 /**
  * Print progress bar state
+ * The bar is redrawn only if its value changed by one per mille at least,
+ * as searched pieces may be very short.
  * @param pb Progress bar structure pointer
  * @param value Actual progress bar value between min and max
  */
@@ -27,6 +33,10 @@ void set_txt_progress_bar(prog_t *pb, double value)
 	double percent = (value - pb->min) / intw;
 	int width = pb->width - PB_EXTRA_CHARS;
 	
+	if ((int) (percent * 1000) == pb->drawn)
+		return;
+	pb->drawn = percent * 1000;
+	
 	int nchar = (int) (percent * width);
 	int nblank = width - nchar;
 	
@@ -37,3 +47,32 @@ void set_txt_progress_bar(prog_t *pb, double value)
 		Rprintf(" ");
 	Rprintf("|%4.f%%", percent * 100);
 }
+
+
+/**
+ * Increase progress bar value and redraw it
+ * NOTE Thread-safe, but only the main thread prints,
+ * as R output functions must not be called from other threads
+ * @param pb Progress bar structure pointer
+ * @param inc Value increment
+ */
+void step_txt_progress_bar(prog_t *pb, double inc)
+{
+	double value;
+#ifdef _OPENMP
+	#pragma omp atomic
+	pb->value += inc;
+	
+	for (int level = omp_get_level(); level > 0; level--)
+	{// Not called from the main thread
+		if (omp_get_ancestor_thread_num(level) != 0)
+			return;
+	}
+	#pragma omp atomic read
+	value = pb->value;
+#else
+	pb->value += inc;
+	value = pb->value;
+#endif
+	set_txt_progress_bar(pb, value);
+}
@@ -18,8 +18,11 @@ typedef struct
 	double min;
 	double max;
 	int width;
+	double value; /* Actual value, shared by all search threads */
+	int drawn;    /* Drawn value in per mille, -1 if not drawn yet */
 } prog_t;
 
 void set_txt_progress_bar(prog_t *pb, double value);
+void step_txt_progress_bar(prog_t *pb, double inc);
 
 #endif // PROGRESS_H
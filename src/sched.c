@@ -0,0 +1,199 @@
+/**
+ * Triplex package
+ * Work-stealing task scheduler
+ *
+ * @file    sched.c
+ * @package triplex
+ */
+
+#include <R.h>
+#include <Rinternals.h>
+#include <stdlib.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "sched.h"
+
+typedef struct
+{// Task with its estimated cost
+	double cost;
+	int task;
+} t_task;
+
+typedef struct
+{// Task queue of one worker, sorted from the largest task
+	t_task *task;
+	int first;    /* First queued task */
+	int last;     /* One after the last queued task */
+	double work;  /* Cost of queued tasks */
+#ifdef _OPENMP
+	omp_lock_t lock;
+#endif
+} t_queue;
+
+
+/**
+ * Compare tasks by decreasing cost, then by increasing index
+ * @param a First task
+ * @param b Second task
+ * @return Comparison result for qsort
+ */
+static int cmp_task(const void *a, const void *b)
+{
+	const t_task *ta = a, *tb = b;
+	
+	if (ta->cost != tb->cost)
+		return (ta->cost < tb->cost) ? 1 : -1;
+	
+	return ta->task - tb->task;
+}
+
+
+/**
+ * Take the largest task from the queue
+ * @param q Task queue
+ * @return Task index or -1 if the queue is empty
+ */
+static int queue_pop(t_queue *q)
+{
+	int task = -1;
+#ifdef _OPENMP
+	omp_set_lock(&q->lock);
+#endif
+	if (q->first < q->last)
+	{
+		task = q->task[q->first].task;
+		q->work -= q->task[q->first].cost;
+		q->first++;
+	}
+#ifdef _OPENMP
+	omp_unset_lock(&q->lock);
+#endif
+	return task;
+}
+
+
+/**
+ * Get next task for the worker, steal one if its own queue is empty
+ * @param queue Queues of all workers
+ * @param nqueues Number of queues
+ * @param w Worker index
+ * @return Task index or -1 if there is no task left
+ */
+static int next_task(t_queue *queue, int nqueues, int w)
+{
+	int task, victim;
+	double work, max_work;
+	
+	if ((task = queue_pop(&queue[w])) >= 0)
+		return task;
+	
+	do
+	{// Steal the largest task of the most loaded worker
+		victim = -1;
+		max_work = 0;
+		
+		for (int i = 0; i < nqueues; i++)
+		{
+#ifdef _OPENMP
+			omp_set_lock(&queue[i].lock);
+#endif
+			work = (queue[i].first < queue[i].last) ? queue[i].work : -1;
+#ifdef _OPENMP
+			omp_unset_lock(&queue[i].lock);
+#endif
+			if (work >= 0 && (victim < 0 || work > max_work))
+			{
+				victim = i;
+				max_work = work;
+			}
+		}
+		if (victim < 0)
+			return -1;
+		
+		/* Another thief may have been faster, try again then */
+		task = queue_pop(&queue[victim]);
+	}
+	while (task < 0);
+	
+	return task;
+}
+
+
+/**
+ * Run tasks on nthreads threads
+ * Tasks are dispatched from the largest one, so the last running tasks
+ * are small ones. Every worker owns a queue and steals from the most
+ * loaded worker once its queue gets empty.
+ * @param cost Estimated cost of every task
+ * @param ntasks Number of tasks
+ * @param nthreads Number of threads
+ * @param fn Task function
+ * @param arg User data passed to task function
+ */
+void sched_run(
+	const double *cost, int ntasks, int nthreads, task_fn_t fn, void *arg)
+{
+	if (ntasks <= 0)
+		return;
+	if (nthreads > ntasks)
+		nthreads = ntasks;
+	if (nthreads < 1)
+		nthreads = 1;
+	
+	t_task *task = malloc(ntasks * sizeof(t_task));
+	t_queue *queue = malloc(nthreads * sizeof(t_queue));
+	if (task == NULL || queue == NULL)
+		error("Failed to allocate memory for task scheduler.");
+	
+	for (int i = 0; i < ntasks; i++)
+	{
+		task[i].cost = cost[i];
+		task[i].task = i;
+	}
+	qsort(task, ntasks, sizeof(t_task), cmp_task);
+	
+	for (int w = 0; w < nthreads; w++)
+	{// Deal tasks round-robin, every queue starts with a large task
+		queue[w].task = malloc(((ntasks - w + nthreads - 1) / nthreads) * sizeof(t_task));
+		if (queue[w].task == NULL)
+			error("Failed to allocate memory for task scheduler.");
+		
+		queue[w].first = queue[w].last = 0;
+		queue[w].work = 0;
+		for (int i = w; i < ntasks; i += nthreads)
+		{
+			queue[w].task[queue[w].last++] = task[i];
+			queue[w].work += task[i].cost;
+		}
+#ifdef _OPENMP
+		omp_init_lock(&queue[w].lock);
+#endif
+	}
+	
+#ifdef _OPENMP
+	#pragma omp parallel num_threads(nthreads)
+#endif
+	{
+#ifdef _OPENMP
+		int w = omp_get_thread_num();
+#else
+		int w = 0;
+#endif
+		int t;
+		while ((t = next_task(queue, nthreads, w)) >= 0)
+			fn(t, w, arg);
+	}
+	
+	for (int w = 0; w < nthreads; w++)
+	{
+#ifdef _OPENMP
+		omp_destroy_lock(&queue[w].lock);
+#endif
+		free(queue[w].task);
+	}
+	free(queue);
+	free(task);
+}
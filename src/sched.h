@@ -0,0 +1,22 @@
+/**
+ * Triplex package
+ * Header file for work-stealing task scheduler
+ *
+ * @file    sched.h
+ * @package triplex
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+/* Task function, called exactly once for every task
+ * @param task Task index
+ * @param worker Index of the thread running the task
+ * @param arg User data */
+typedef void (*task_fn_t)(int task, int worker, void *arg);
+
+void sched_run(
+	const double *cost, int ntasks, int nthreads, task_fn_t fn, void *arg
+);
+
+#endif // SCHED_H
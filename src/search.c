@@ -13,18 +13,23 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "search.h"
 #include "search_interface.h"
 #include "progress.h"
-
-/* Status variable flags */
-#define STAT_NONE     0
-#define STAT_QUALITY  1
-#define STAT_MINLEN   2
-#define STAT_EXPORT   4
+#include "sched.h"
+#include "kernel.h"
+#include "cache.h"
+#include "seed.h"
+#include "filter.h"
 
 double RN[NUM_SEQ_TYPES][NUM_TRI_TYPES];
 double MI[NUM_SEQ_TYPES][NUM_TRI_TYPES];
@@ -41,65 +46,140 @@ typedef enum
 } ad_states_t;
 
 
+typedef struct
+{// Piece of a stream, @see search_stream_task
+	int row0;   /* First row, lower rows were computed by previous piece */
+	int cont;   /* Triplexes continue to the next piece */
+} t_stream;
+
+
+typedef struct
+{// Pruning controller of a piece, @see prune_update
+	double eff[PRUNE_BUCKETS + 1];  /* Ratio of pruned cells to cells under
+	                                   treshold by ratio of cells under treshold */
+	int under;      /* Cells under treshold of the last antidiagonal */
+	int bucket;     /* Ratio bucket of the last antidiagonal */
+	int predicted;  /* Cells predicted to be pruned */
+} t_prune;
+
+
+typedef struct
+{// Score bound of diagonals of a piece, @see diag_alive
+	const char *piece;  /* Encoded piece sequence */
+	int rows;           /* Number of rows of the piece */
+	int cont;           /* Rows after the piece are searched by the next piece */
+	int last_ad;        /* Last computed antidiagonal */
+	int min_score;      /* Minimal score of a triplex */
+	int sure;           /* Scores reaching min_score with an indel */
+	int bonus[NBASES*NBASES];     /* Maximal bonus of a match of triplet a*4+b */
+} t_bound;
+
+
 /** Function prototypes **/
-void export_data(t_diag diag, int tri_type, int offset, int seq_len, int seq_type);
+void export_data(
+	t_dstate *ds, int d, int tri_type, int64_t offset, const t_pvalue *pv,
+	t_dl_buf *buf
+);
 void search(
-	char *piece, int piece_l, int offset, int seq_len, int seq_type, int n_antidiag,
-	int max_bonus, t_diag *diag, t_params *params, t_penalization *pen, prog_t *pb
+	char *piece, int piece_l, int64_t offset, const t_pvalue *pv, int n_antidiag,
+	int max_bonus, t_dstate *ds, const t_kernel *kern, t_params *params,
+	t_penalization *pen, t_dl_buf *buf, intv_buf_t *regions, int head, int tail,
+	t_stream *stream, t_sweep *sweep
 );
 
-void print_score_array(t_diag* ptr, int size, int border);
-void print_rule_array(t_diag* ptr, int size, int border);
-void print_status_array(t_diag* ptr, int size, int border);
+void print_score_array(t_dstate *ds, int size, int border);
+void print_rule_array(t_dstate *ds, int size, int border);
+void print_status_array(t_dstate *ds, int size, int border);
+
+
 
+/* P-value tables kept between searches, @see pvalue_table */
+static t_pvalue PV_TABLE[NUM_SEQ_TYPES][NUM_TRI_TYPES];
 
 
 /**
- * P function: P(S>=x)
+ * P-value
+ * P function P(S>=x) is corrected for the number of tests
+ * given by the sequence length.
+ * @param t P-value table providing the constants
  * @param score Triplex score
+ * @return P-value
+ */
+static inline double p_value(const t_pvalue *t, int score)
+{
+	double p_function = 1-exp(-exp(-t->lambda*(score-t->mi)));
+	return 1-exp(-t->rn*t->seq_len*p_function);
+}
+
+
+/**
+ * Get P-value table of scores 0..size-1
+ * Tables are kept between calls, so only missing scores are computed
+ * unless the sequence length or the constants change.
+ * NOTE Not thread safe, tables are built before the search starts
  * @param tri_type Triplex type
- * @return P function value
+ * @param seq_len Sequence length
+ * @param seq_type Sequence type
+ * @param size Minimal number of scores
+ * @return P-value table, its size is lower if it failed to grow
  */
-static inline double p_function(int score, int tri_type, int seq_type)
+static const t_pvalue *pvalue_table(int tri_type, int64_t seq_len, int seq_type, int size)
 {
-	return 1-exp(-exp(-LAMBDA[seq_type][tri_type]*(score-MI[seq_type][tri_type])));
+	t_pvalue *t = &PV_TABLE[seq_type][tri_type];
+	
+	if (t->seq_len != seq_len ||
+	    t->lambda != LAMBDA[seq_type][tri_type] ||
+	    t->mi != MI[seq_type][tri_type] ||
+	    t->rn != RN[seq_type][tri_type])
+	{// Other search constants
+		t->lambda = LAMBDA[seq_type][tri_type];
+		t->mi = MI[seq_type][tri_type];
+		t->rn = RN[seq_type][tri_type];
+		t->seq_len = seq_len;
+		t->size = 0;
+	}
+	if (size > t->size)
+	{
+		double *p = realloc(t->p, size * sizeof(double));
+		if (p == NULL)
+			return t;
+		
+		for (int score = t->size; score < size; score++)
+			p[score] = p_value(t, score);
+		
+		t->p = p;
+		t->size = size;
+	}
+	return t;
 }
 
 
 /**
- * P-value
+ * Get P-value of a score, scores out of the table are computed
+ * @param t P-value table
  * @param score Triplex score
- * @param tri_type Triplex type
- * @param seq_len DNA sequence length
  * @return P-value
  */
-static inline double p_value(int score, int tri_type, int seq_len, int seq_type)
+static inline double pvalue_get(const t_pvalue *t, int score)
 {
-	return 1-exp(-RN[seq_type][tri_type]*seq_len*p_function(score, tri_type, seq_type));
+	if (score >= 0 && score < t->size)
+		return t->p[score];
+	
+	return p_value(t, score);
 }
 
 
 /**
- * Search triplex in DNA sequence
- * @param dna encoed DNA sequence, @see encode_bases
- * @param chunk Interval list of chunks divided by N or - symbols
- * @param params Algorithm options
- * @param pen Custom penalizations
- * @param pbw Progress bar width
+ * Raise minimal score to the one deduced from P-value if it is higher
+ * NOTE Called for every searched type in the order of type vector,
+ * so the minimal score of one type is carried over to the next one
+ * @param params Algorithm options with tri_type set
+ * @param seq_len Sequence length
+ * @param seq_type Sequence type
  */
-void main_search(seq_t dna, intv_t *chunk, t_params *params, t_penalization *pen, int pbw)
+void set_min_score(t_params *params, int64_t seq_len, int seq_type)
 {
-	Rprintf("Searching for triplex type %d...\n", params->tri_type);
-	
-	int chunk_len, npieces, delta, piece_l, last_piece_l, min_score;
-	
-	t_diag *diag = malloc(3*MAX_PIECE_SIZE * sizeof(t_diag));
-	//static t_diag diag[3*MAX_PIECE_SIZE]; // One MAX_PIECE_SIZE extra for piece_overlap
-	
-	// Maximal bonus per match
-	int max_bonus = get_max_bonus(params->tri_type, pen->iso_stay);
-	
-	min_score = get_min_score(params->p_val, params->tri_type, dna.len, dna.type);
+	int min_score = get_min_score(params->p_val, params->tri_type, seq_len, seq_type);
 	if (min_score > params->min_score)
 	// Use minimal score deduced from P-value for better performance
 		params->min_score = min_score;
@@ -107,74 +187,560 @@ void main_search(seq_t dna, intv_t *chunk, t_params *params, t_penalization *pen
 	/* NOTE: Maybe now could be all the filtration conditions considering
 	 * p_val removed from search() and get_max_score()
 	 * as this is now well represented by min_score */
+}
+
+
+/**
+ * Choose number of rows of a piece
+ * DP state of a piece is accessed on every antidiagonal, so the piece and
+ * its state should fit half of L2 cache, the other half is left for results
+ * and the other hardware thread of the core. Pieces fitting L1 cache or
+ * shorter than PIECE_OVERLAP_RATIO overlaps are not worth of the overlap.
+ * @param n_antidiag Maximal number of antidiagonals of searched types
+ * @param wide Some type needs wide DP state
+ * @param tune Piece size options, unset options are filled in
+ * @return Number of rows
+ */
+static int get_piece_size(int n_antidiag, int wide, t_tune *tune)
+{
+	long row_size = 2*(wide ? DS_WIDE_DIAG_SIZE : DS_DIAG_SIZE) + 1;
+	long rows = tune->piece_size;
 	
-	// Number of antidiagonals per triplex
-	int n_antidiag = get_n_antidiag(
-		max_bonus, pen->insertion, params->max_len, params->min_score,
-		params->max_loop
-	);
-	
-	int pieces_overlap = n_antidiag;
+	if (rows <= 0)
+	{
+		long budget = (tune->budget > 0) ? tune->budget : cache_size(2)/2;
+		long min_rows = cache_size(1)/row_size;
+		
+		rows = budget/row_size - n_antidiag;
+		if (rows > 1024)
+			rows &= ~1023L;
+		if (rows < min_rows)
+			rows = min_rows;
+		if (rows < (long) PIECE_OVERLAP_RATIO*n_antidiag)
+			rows = (long) PIECE_OVERLAP_RATIO*n_antidiag;
+	}
+	if (rows > MAX_PIECE_SIZE)
+		rows = MAX_PIECE_SIZE;
+	if (rows < n_antidiag)
+	// Only the last piece of a chunk may be shorter than the overlap
+		rows = n_antidiag;
+	tune->piece_size = rows;
+	tune->budget = (rows + n_antidiag)*row_size;
+	return rows;
+}
+
+
+/**
+ * Divide chunks into overlapping pieces
+ * Pieces overlap by n_antidiag bases, so every diagonal of a chunk is
+ * searched whole by some piece. The other pieces cut it at their first
+ * or last row and do not export it there, @see search. So results do not
+ * depend on the piece size.
+ * @param chunk Interval list of chunks divided by N or - symbols
+ * @param piece_size Number of rows of a piece
+ * @param min_ad First antidiagonal of pieces
+ * @param n_antidiag Number of antidiagonals, bases shared by subsequent pieces
+ * @param band First antidiagonal and number of antidiagonals of every
+ *   chunk or NULL, @see get_seed_chunks
+ * @param npieces Output number of pieces
+ * @return Array of pieces in sequence order
+ */
+static t_piece *get_pieces(
+	intv_t *chunk, int piece_size, int min_ad, int n_antidiag, const int *band,
+	int *npieces)
+{
+	int64_t chunk_len, n, last_piece_l;
+	int count = 0, size = 0, pieces_overlap;
+	t_piece *piece = NULL;
 	
-	/* Initialize progress bar structure */
-	prog_t pb = {0, dna.len, pbw};
+	for (intv_t *c = chunk; c != NULL; c = c->next)
+		size += ceil((c->end - c->start + 1) / (double) piece_size);
 	
-	if (pb.max >= PB_SHOW_LIMIT)
-	/* Draw progress bar initially */
-		set_txt_progress_bar(&pb, 0);
+	piece = malloc((size > 0 ? size : 1) * sizeof(t_piece));
+	if (piece == NULL)
+		error("Failed to allocate memory for sequence pieces.");
 	
-	while (chunk != NULL)
+	for (int w = 0; chunk != NULL; w++)
 	{
+		if (band != NULL)
+		{
+			min_ad = band[2*w];
+			n_antidiag = band[2*w+1];
+		}
+		pieces_overlap = n_antidiag;
 		chunk_len = chunk->end - chunk->start + 1;
-		npieces = ceil(chunk_len / (double) MAX_PIECE_SIZE);
-		delta = MAX_PIECE_SIZE;
-		
-		piece_l = MAX_PIECE_SIZE + pieces_overlap;
-		last_piece_l = chunk_len - (npieces-1)*MAX_PIECE_SIZE;
+		n = ceil(chunk_len / (double) piece_size);
+		last_piece_l = chunk_len - (n-1)*piece_size;
 		
 		/* If last piece is shorter than overlap, then remove it from computation
 		 * because previous piece (if exist) calculates its */
-		if ((last_piece_l <= pieces_overlap) && (npieces > 1))
+		if ((last_piece_l <= pieces_overlap) && (n > 1))
 		{
-			npieces--;
-			last_piece_l = chunk_len - (npieces-1)*MAX_PIECE_SIZE;
+			n--;
+			last_piece_l = chunk_len - (n-1)*piece_size;
 			/* NOTE: should be same as
-			 * last_piece_l = MAX_PIECE_SIZE + last_piece_l */
+			 * last_piece_l = piece_size + last_piece_l */
 		}
 		
-		for (int j = 0, piece_offset = chunk->start;
-		     j < npieces;
-		     j++, piece_offset += delta)
-		{// Iterate through pieces
-			
-			if (j == npieces-1) piece_l = last_piece_l;
-			
-			// Diag structure initialization
-			for (int i = 0; i < 2*piece_l; i++)
+		for (int64_t j = 0; j < n; j++, count++)
+		{
+			piece[count].offset = chunk->start + j*piece_size;
+			piece[count].len = (j == n-1) ? last_piece_l : piece_size + pieces_overlap;
+			piece[count].step = (j == n-1) ? last_piece_l : piece_size;
+			piece[count].min_ad = min_ad;
+			piece[count].n_antidiag = n_antidiag;
+			piece[count].head = (j == 0);
+			piece[count].tail = (j == n-1);
+		}
+		chunk = chunk->next;
+	}
+	*npieces = count;
+	return piece;
+}
+
+
+/**
+ * Get one piece per chunk for stream search, @see search_stream_task
+ * @param chunk Interval list of chunks divided by N or - symbols
+ * @param min_ad First antidiagonal of pieces
+ * @param n_antidiag Number of antidiagonals of pieces
+ * @param band First antidiagonal and number of antidiagonals of every
+ *   chunk or NULL, @see get_seed_chunks
+ * @param npieces Output number of pieces
+ * @return Array of pieces in sequence order
+ */
+static t_piece *get_stream_pieces(
+	intv_t *chunk, int min_ad, int n_antidiag, const int *band, int *npieces)
+{
+	int count = 0;
+	t_piece *piece = NULL;
+	
+	for (intv_t *c = chunk; c != NULL; c = c->next)
+		count++;
+	
+	piece = malloc((count > 0 ? count : 1) * sizeof(t_piece));
+	if (piece == NULL)
+		error("Failed to allocate memory for sequence pieces.");
+	
+	count = 0;
+	for (intv_t *c = chunk; c != NULL; c = c->next, count++)
+	{
+		piece[count].offset = c->start;
+		piece[count].len = c->end - c->start + 1;
+		piece[count].step = piece[count].len;
+		piece[count].min_ad = band ? band[2*count] : min_ad;
+		piece[count].n_antidiag = band ? band[2*count+1] : n_antidiag;
+		piece[count].head = piece[count].tail = 1;
+	}
+	*npieces = count;
+	return piece;
+}
+
+
+typedef struct
+{// Shared data of search tasks
+	seq_t dna;
+	t_piece *piece;
+	t_params *params;
+	t_penalization *pen;
+	int *max_bonus;
+	const t_pvalue **pv; /* P-value tables of every type */
+	int piece_size;
+	t_kernel *kern;
+	char *diag;
+	size_t diag_size;
+	char *bases;         /* Decoded piece of every thread, @see seq_decode */
+	size_t bases_size;
+	t_dl_buf *buf;
+	intv_buf_t *regions; /* Two interval arrays of every thread */
+	t_sweep *sweep;      /* Sweep of every type or NULL, @see sweep_mark */
+	prog_t *pb;
+	int *member;   /* Pieces of fused tasks */
+	int *mfirst;   /* First member of every fused task */
+	task_fn_t run; /* Search of one piece, search_task or search_stream_task */
+} t_search_task;
+
+
+/**
+ * Search one piece of the sequence for one triplex type
+ * @param task Piece index
+ * @param worker Thread searching the piece
+ * @param arg Search task data, @see t_search_task
+ */
+static void search_task(int task, int worker, void *arg)
+{
+	t_search_task *st = arg;
+	t_piece *piece = &st->piece[task];
+	t_params params = st->params[piece->type];
+	t_dl_buf *buf = &st->buf[worker];
+	char *bases = st->bases + worker*st->bases_size;
+	t_dstate ds;
+	
+	// Loops start at the first antidiagonal of the piece
+	params.min_loop = piece->min_ad - 1;
+	
+	seq_decode(&st->dna, piece->offset, piece->len, bases);
+	
+	dstate_init(&ds, st->diag + worker*st->diag_size, 2*piece->len, st->kern[piece->type].wide);
+	dstate_reset(&ds, 2*piece->len, params.min_loop);
+	
+	piece->worker = worker;
+	piece->first = buf->size;
+	search(
+		bases, piece->len, piece->offset, st->pv[piece->type],
+		piece->n_antidiag, st->max_bonus[piece->type],
+		&ds, &st->kern[piece->type], &params, st->pen, buf,
+		&st->regions[2*worker], piece->head, piece->tail, NULL,
+		st->sweep ? &st->sweep[piece->type] : NULL
+	);
+	piece->count = buf->size - piece->first;
+	
+	if (st->pb->max >= PB_SHOW_LIMIT)
+	// Redraw progress bar
+		step_txt_progress_bar(st->pb, piece->step);
+}
+
+
+/**
+ * Search one chunk of the sequence for one triplex type as a stream
+ * Chunk is divided into pieces of piece_size rows without overlap.
+ * Every piece starts n_antidiag bases before its first row and DP state
+ * of diagonals unfinished at the end of a piece is handed over to the
+ * next one, @see dstate_shift. So no cell is computed twice.
+ * @param task Chunk index
+ * @param worker Thread searching the chunk
+ * @param arg Search task data, @see t_search_task
+ */
+static void search_stream_task(int task, int worker, void *arg)
+{
+	t_search_task *st = arg;
+	t_piece *chunk = &st->piece[task];
+	t_params params = st->params[chunk->type];
+	t_dl_buf *buf = &st->buf[worker];
+	char *bases = st->bases + worker*st->bases_size;
+	int n_antidiag = chunk->n_antidiag;
+	int rows = (chunk->len < st->piece_size) ? chunk->len : st->piece_size;
+	int n_diag = 2*(rows + n_antidiag);
+	int64_t start = 0, offset = chunk->offset;
+	t_stream stream = {0, 0};
+	t_dstate ds;
+	
+	// Loops start at the first antidiagonal of the chunk
+	params.min_loop = chunk->min_ad - 1;
+	
+	dstate_init(&ds, st->diag + worker*st->diag_size, n_diag, st->kern[chunk->type].wide);
+	dstate_reset(&ds, n_diag, params.min_loop);
+	
+	chunk->worker = worker;
+	chunk->first = buf->size;
+	while (1)
+	{
+		rows = (chunk->len - start < st->piece_size) ? chunk->len - start : st->piece_size;
+		
+		int piece_l = stream.row0 + rows;
+		stream.cont = (start + rows < chunk->len);
+		
+		seq_decode(&st->dna, offset, piece_l, bases);
+		search(
+			bases, piece_l, offset, st->pv[chunk->type],
+			n_antidiag, st->max_bonus[chunk->type], &ds, &st->kern[chunk->type],
+			&params, st->pen, buf, &st->regions[2*worker], 1, 1, &stream,
+			st->sweep ? &st->sweep[chunk->type] : NULL
+		);
+		
+		if (st->pb->max >= PB_SHOW_LIMIT)
+		// Redraw progress bar
+			step_txt_progress_bar(st->pb, rows);
+		
+		if (!stream.cont)
+			break;
+		
+		/* Next piece starts n_antidiag bases before its first row */
+		start += rows;
+		int shift = chunk->offset + start - n_antidiag - offset;
+		int first = 2*piece_l + 2 - n_antidiag;
+		
+		dstate_shift(
+			&ds, (first > 1) ? first : 1, 2*piece_l - 1, 2*shift, n_diag,
+			params.min_loop
+		);
+		offset += shift;
+		stream.row0 = n_antidiag;
+	}
+	chunk->count = buf->size - chunk->first;
+}
+
+
+/**
+ * Search one piece of the sequence for all types one after another
+ * The piece and the diag array stay in cache between the types.
+ * @param task Fused task index
+ * @param worker Thread searching the piece
+ * @param arg Search task data, @see t_search_task
+ */
+static void search_fused_task(int task, int worker, void *arg)
+{
+	t_search_task *st = arg;
+	
+	for (int m = st->mfirst[task]; m < st->mfirst[task+1]; m++)
+		st->run(st->member[m], worker, arg);
+}
+
+
+/**
+ * Group pieces of all types by their offset into fused tasks
+ * Pieces of every type are sorted by offset and the offsets differ
+ * only by last pieces merged into the previous ones.
+ * @param task Pieces of all types
+ * @param first First piece of every type, ntypes+1 items
+ * @param ntypes Number of types
+ * @param cost Cost of every piece
+ * @param member Output piece indices in task order, ntasks items
+ * @param mfirst Output first member of every fused task, ntasks+1 items
+ * @param mcost Output cost of every fused task, ntasks items
+ * @return Number of fused tasks
+ */
+static int fuse_pieces(
+	t_piece *task, int *first, int ntypes, double *cost,
+	int *member, int *mfirst, double *mcost)
+{
+	int pos[NUM_TRI_TYPES];
+	int n = 0, m = 0;
+	
+	for (int i = 0; i < ntypes; i++)
+		pos[i] = first[i];
+	
+	while (1)
+	{
+		int64_t offset = -1;
+		for (int i = 0; i < ntypes; i++)
+		{
+			if (pos[i] < first[i+1] && (offset < 0 || task[pos[i]].offset < offset))
+				offset = task[pos[i]].offset;
+		}
+		if (offset < 0)
+			break;
+		
+		mfirst[n] = m;
+		mcost[n] = 0;
+		for (int i = 0; i < ntypes; i++)
+		{
+			if (pos[i] < first[i+1] && task[pos[i]].offset == offset)
 			{
-				diag[i].score = 0;
-				diag[i].max_score = 0;
-				diag[i].bound = 0;
-				diag[i].twist = 90;
-				diag[i].dtwist = 0;
-				diag[i].status = STAT_NONE;
-				diag[i].start.diag = i;
-				diag[i].start.antidiag = (((params->min_loop+i) % 2) == 0) ? params->min_loop+1 : params->min_loop+2;
-				diag[i].max_score_pos.diag = diag[i].start.diag;
-				diag[i].max_score_pos.antidiag = diag[i].start.antidiag;
-				diag[i].indels = 0;
-				diag[i].max_indels = 0;
-				diag[i].dp_rule = DP_MISMATCH;
+				mcost[n] += cost[pos[i]];
+				member[m++] = pos[i]++;
 			}
-			search(dna.seq + piece_offset, piece_l, piece_offset, dna.len, dna.type, n_antidiag, max_bonus, diag, params, pen, &pb);
 		}
-		chunk = chunk->next;
+		n++;
+	}
+	mfirst[n] = m;
+	return n;
+}
+
+
+/**
+ * Search triplex in DNA sequence
+ * Pieces of all given types are searched as one pool of tasks by nthreads
+ * threads, the most expensive pieces first, @see sched_run. If there are
+ * enough pieces, one task searches a piece for all types, so the sequence
+ * is scanned only once. Every thread has its own diag array and result
+ * buffer. Buffered results are inserted into the lists in piece order
+ * and lists are group filtered, so the result is the same for any number
+ * of threads.
+ * @param dna encoed DNA sequence, @see encode_bases
+ * @param chunk Interval list of chunks divided by N or - symbols
+ * @param params Algorithm options for every type, @see set_min_score
+ * @param ntypes Number of searched types
+ * @param pen Custom penalizations
+ * @param pb Progress bar shared by all searched types
+ * @param list Result list for every type
+ * @param nthreads Number of threads
+ * @param tune Piece size options, the chosen ones are filled in
+ * @param sweep Sweep of every type marked by the search or NULL
+ */
+void main_search(
+	seq_t dna, intv_t *chunk, t_params *params, int ntypes, t_penalization *pen,
+	prog_t *pb, t_dl_list *list, int nthreads, t_tune *tune, t_sweep *sweep)
+{
+	int max_bonus[NUM_TRI_TYPES], n_antidiag[NUM_TRI_TYPES];
+	const t_pvalue *pv[NUM_TRI_TYPES];
+	int first[NUM_TRI_TYPES + 1];
+	int npieces, ntasks = 0, max_overlap = 0, wide = 0;
+	int stream = (ntypes > 0) && params[0].stream;
+	t_kernel kern[NUM_TRI_TYPES];
+	t_piece *piece[NUM_TRI_TYPES];
+	
+	for (int i = 0; i < ntypes; i++)
+	{
+		// Maximal bonus per match
+		max_bonus[i] = get_max_bonus(params[i].tri_type, pen->iso_stay);
+		
+		// Number of antidiagonals per triplex
+		n_antidiag[i] = get_n_antidiag(
+			max_bonus[i], pen->insertion, params[i].max_len, params[i].min_score,
+			params[i].max_loop
+		);
+		
+		if (kernel_select(&kern[i], params[i].tri_type, pen, n_antidiag[i]) < 0)
+			error("Too high scores allowed by max_len and penalization options.");
+		
+		if (n_antidiag[i] > (kern[i].wide ? DS_MAX_ANTIDIAG_WIDE : DS_MAX_ANTIDIAG))
+			error("Too long triplexes allowed by max_len, max_loop and ins_pen options.");
+		wide |= kern[i].wide;
+		
+		// P-values of all reachable scores, ahead of worker threads
+		pv[i] = pvalue_table(
+			params[i].tri_type, dna.len, dna.type,
+			n_antidiag[i]/2*max_bonus[i] + 1
+		);
+		
+		if (max_overlap < n_antidiag[i])
+			max_overlap = n_antidiag[i];
+	}
+	
+	int piece_size = get_piece_size(max_overlap, wide, tune);
+	
+	// Stream pieces hand diagonals over only to the next piece
+	if (max_overlap > 2*piece_size)
+		stream = 0;
+	
+	for (int i = 0; i < ntypes; i++)
+	{
+		intv_t *seeds = NULL, *c;
+		int *band = NULL;
+		
+		// Cut out parts unable to hold a triplex
+		intv_t *tracts = NULL;
+		c = chunk;
+		if (params[i].prefilter)
+		{
+			tracts = get_tract_chunks(
+				dna, chunk, params[i].tri_type, pen, params[i].min_score, n_antidiag[i]
+			);
+			c = tracts;
+		}
+		
+		if (params[i].seed_len > 0)
+		{// Search only around mirror k-mer seeds
+			int stem = n_antidiag[i] - params[i].max_loop;
+			seeds = get_seed_chunks(
+				dna, c, params[i].tri_type, params[i].seed_len,
+				params[i].min_loop + 1, params[i].seed_band ? stem : n_antidiag[i],
+				n_antidiag[i], &band
+			);
+			c = seeds;
+		}
+		
+		if (stream)
+			piece[i] = get_stream_pieces(
+				c, params[i].min_loop + 1, n_antidiag[i], band, &npieces
+			);
+		else
+			piece[i] = get_pieces(
+				c, piece_size, params[i].min_loop + 1, n_antidiag[i], band, &npieces
+			);
+		free_intv(tracts);
+		free_intv(seeds);
+		free(band);
+		first[i] = ntasks;
+		ntasks += npieces;
+	}
+	// One piece_size extra for piece_overlap
+	size_t diag_size = dstate_size(2*(piece_size + max_overlap), wide);
+	size_t bases_size = piece_size + max_overlap;
+	first[ntypes] = ntasks;
+	
+	if (nthreads > ntasks)
+		nthreads = ntasks;
+	if (nthreads < 1)
+		nthreads = 1;
+	
+	t_piece *task = malloc((ntasks > 0 ? ntasks : 1) * sizeof(t_piece));
+	double *cost = malloc((ntasks > 0 ? ntasks : 1) * sizeof(double));
+	char *diag = malloc(nthreads * diag_size);
+	char *bases = malloc(nthreads * bases_size);
+	t_dl_buf *buf = malloc(nthreads * sizeof(t_dl_buf));
+	intv_buf_t *regions = malloc(2*nthreads * sizeof(intv_buf_t));
+	if (task == NULL || cost == NULL || diag == NULL || bases == NULL || buf == NULL || regions == NULL)
+		error("Failed to allocate memory for search workspace.");
+	
+	for (int i = 0; i < ntypes; i++)
+	{// Pool pieces of all types, cost is the number of computed cells
+		for (int j = first[i]; j < first[i+1]; j++)
+		{
+			task[j] = piece[i][j - first[i]];
+			task[j].type = i;
+			cost[j] = (double) task[j].len * (task[j].n_antidiag - task[j].min_ad);
+		}
+		free(piece[i]);
+	}
+	
+	for (int w = 0; w < nthreads; w++)
+		dl_buf_init(&buf[w]);
+	for (int w = 0; w < 2*nthreads; w++)
+		intv_buf_init(&regions[w], REGIONS_INIT_SIZE);
+	
+	t_search_task st = {
+		dna, task, params, pen, max_bonus, pv, piece_size, kern, diag,
+		diag_size, bases, bases_size, buf, regions, sweep, pb, NULL, NULL,
+		stream ? search_stream_task : search_task
+	};
+	
+	int *member = malloc((ntasks > 0 ? ntasks : 1) * sizeof(int));
+	int *mfirst = malloc((ntasks + 1) * sizeof(int));
+	double *mcost = malloc((ntasks > 0 ? ntasks : 1) * sizeof(double));
+	if (member == NULL || mfirst == NULL || mcost == NULL)
+		error("Failed to allocate memory for search workspace.");
+	
+	int nfused = fuse_pieces(task, first, ntypes, cost, member, mfirst, mcost);
+	
+	if (ntypes > 1 && nfused >= FUSED_MIN_PIECES*nthreads)
+	{// Scan every piece once for all types
+		st.member = member;
+		st.mfirst = mfirst;
+		sched_run(mcost, nfused, nthreads, search_fused_task, &st);
 	}
+	else
+		sched_run(cost, ntasks, nthreads, st.run, &st);
 	
+	free(member);
+	free(mfirst);
+	free(mcost);
 	free(diag);
+	free(bases);
+	for (int w = 0; w < 2*nthreads; w++)
+		intv_buf_free(&regions[w]);
+	free(regions);
+	free(cost);
+	
+	int failed = 0;
+	for (int w = 0; w < nthreads; w++)
+		failed |= buf[w].failed;
 	
-	if (pb.max >= PB_SHOW_LIMIT)
-		Rprintf("\n");
+	if (!failed)
+	{
+#ifdef _OPENMP
+		#pragma omp parallel for num_threads(nthreads < ntypes ? nthreads : ntypes) schedule(dynamic, 1)
+#endif
+		for (int i = 0; i < ntypes; i++)
+		{// Merge buffered results in piece order, types are independent
+			for (int j = first[i]; j < first[i+1]; j++)
+			{
+				t_dl_data *data = buf[task[j].worker].data + task[j].first;
+				for (int64_t k = 0; k < task[j].count; k++)
+					dl_list_insert(&list[i], data[k]);
+			}
+			dl_list_group_filter(&list[i]);
+		}
+	}
+	
+	for (int w = 0; w < nthreads; w++)
+		dl_buf_free(&buf[w]);
+	free(buf);
+	free(task);
+	
+	if (failed)
+		error("Failed to allocate memory for search results.");
 }
 
 
@@ -187,44 +753,66 @@ void main_search(seq_t dna, intv_t *chunk, t_params *params, t_penalization *pen
  * @param seq_type Sequence type
  * @return Minimal score
  */
-int get_min_score(double pvalue, int type, int seq_len, int seq_type)
+int get_min_score(double pvalue, int type, int64_t seq_len, int seq_type)
 {
+	const t_pvalue *t = pvalue_table(type, seq_len, seq_type, PVALUE_INIT_SIZE);
 	int score = 1;
 	
-	while (p_value(score, type, seq_len, seq_type) > pvalue)
-		score++;
-	
+	while (pvalue_get(t, score) > pvalue)
+	{
+		if (++score == t->size)
+		// Extend the table
+			t = pvalue_table(type, seq_len, seq_type, 2*t->size);
+	}
 	return score;
 }
 
 
+/**
+ * Export diagonal d if it satisfies P-value
+ * @param c Search context
+ * @param d Diagonal number
+ */
+void export_diag(t_kctx *c, int d)
+{
+	t_params *params = c->params;
+	
+	if (pvalue_get(c->pv, DS_GET(c->ds, max_score, DS_IDX(c->ds, d))) <= params->p_val)
+		export_data(c->ds, d, params->tri_type, c->offset, c->pv, c->buf);
+}
+
+
 /**
  * Export triplex
- * @param diag
+ * @param ds
+ * @param d
  * @param tri_type
  * @param offset
- * @param seq_len
- * @param seq_type
+ * @param pv P-value table
+ * @param buf Result buffer
  */
 void export_data(
-	t_diag diag, int tri_type, int offset, int seq_len, int seq_type)
+	t_dstate *ds, int d, int tri_type, int64_t offset, const t_pvalue *pv,
+	t_dl_buf *buf)
 {
 	int start_ch, end_ch;
 	int start_gap, end_gap;
+	int k = DS_IDX(ds, d);
 	
 	/* calculation of string positions */
-	end_ch = (diag.max_score_pos.diag + diag.max_score_pos.antidiag - 1)/2;
-	start_ch = end_ch - diag.max_score_pos.antidiag;
+	end_ch = (d + DS_GET(ds, max_diag, k) + DS_GET(ds, max_antidiag, k) - 1)/2;
+	start_ch = end_ch - DS_GET(ds, max_antidiag, k);
 	
-	end_gap = (diag.start.diag + diag.start.antidiag - 1)/2;
-	start_gap = end_gap - diag.start.antidiag;
+	end_gap = (d + DS_GET(ds, start_diag, k) + DS_GET(ds, start_antidiag, k) - 1)/2;
+	start_gap = end_gap - DS_GET(ds, start_antidiag, k);
 	
 	save_result(
+		buf,
 		offset + start_ch + 1,
 		offset + end_ch + 1,
-		diag.max_score,
-		p_value(diag.max_score, tri_type, seq_len, seq_type),
-		diag.max_indels,
+		DS_GET(ds, max_score, k),
+		pvalue_get(pv, DS_GET(ds, max_score, k)),
+		DS_GET(ds, max_indels, k),
 		tri_type,
 		offset + start_gap + 1 + 1,  /* correction to loop start character */
 		offset + end_gap + 1 - 1,    /* correction to loop end character */
@@ -235,18 +823,18 @@ void export_data(
 
 /**
  * Print score array
- * @param ptr
+ * @param ds
  * @param size
  * @param border
  */
-void print_score_array(t_diag* ptr, int size, int border) 
+void print_score_array(t_dstate *ds, int size, int border) 
 {
 	int i;
 	for (i=0; i<border; i++) Rprintf(";");
 	
 	for (i=border; i<=size-border; i=i+2)
 	{ 
-		Rprintf("%d", ptr[i].score);
+		Rprintf("%d", DS_GET(ds, score, DS_IDX(ds, i)));
 		Rprintf(";;");
 	}
 	Rprintf("\n");
@@ -255,21 +843,21 @@ void print_score_array(t_diag* ptr, int size, int border)
 
 /**
  * Print rule array
- * @param ptr
+ * @param ds
  * @param size
  * @param border
  */
-void print_rule_array(t_diag* ptr, int size, int border) 
+void print_rule_array(t_dstate *ds, int size, int border) 
 {
 	int i;
 	for (i = 0; i < border; i++) Rprintf(";");
 	
 	for (i = border; i <= size-border; i = i+2)
 	{ 
-		if (ptr[i].dp_rule == DP_MATCH) Rprintf("|");
-		if (ptr[i].dp_rule == DP_MISMATCH) Rprintf("x");
-		if (ptr[i].dp_rule == DP_LEFT) Rprintf("\\");
-		if (ptr[i].dp_rule == DP_RIGHT) Rprintf("/");
+		if (FL_RULE(ds->flags[DS_IDX(ds, i)]) == DP_MATCH) Rprintf("|");
+		if (FL_RULE(ds->flags[DS_IDX(ds, i)]) == DP_MISMATCH) Rprintf("x");
+		if (FL_RULE(ds->flags[DS_IDX(ds, i)]) == DP_LEFT) Rprintf("\\");
+		if (FL_RULE(ds->flags[DS_IDX(ds, i)]) == DP_RIGHT) Rprintf("/");
 		Rprintf(";;");
 	}
 	Rprintf("\n");
@@ -278,21 +866,21 @@ void print_rule_array(t_diag* ptr, int size, int border)
 
 /**
  * Print status array
- * @param ptr
+ * @param ds
  * @param size
  * @param border
  */
-void print_status_array(t_diag* ptr, int size, int border) 
+void print_status_array(t_dstate *ds, int size, int border) 
 {
 	int i;
 	for (i=0; i<border; i++) Rprintf(" ");
 	
 	for (i=border; i<=size-border; i++)
 	{ 
-		if (ptr[i].status == STAT_NONE) Rprintf(" ");
-		if (ptr[i].status == STAT_EXPORT) Rprintf("*");
-		if (ptr[i].status == (STAT_MINLEN|STAT_QUALITY)) Rprintf("|");
-		if (ptr[i].status == STAT_QUALITY) Rprintf(".");
+		if ((ds->flags[DS_IDX(ds, i)] & FL_STATUS) == STAT_NONE) Rprintf(" ");
+		if ((ds->flags[DS_IDX(ds, i)] & FL_STATUS) == STAT_EXPORT) Rprintf("*");
+		if ((ds->flags[DS_IDX(ds, i)] & FL_STATUS) == (STAT_MINLEN|STAT_QUALITY)) Rprintf("|");
+		if ((ds->flags[DS_IDX(ds, i)] & FL_STATUS) == STAT_QUALITY) Rprintf(".");
 	}
 	Rprintf("\n");
 }
@@ -365,16 +953,17 @@ static inline int d_to_end(int ad, int d)
 
 
 /**
- * Create triplex region interval
+ * Append triplex region interval
+ * @param out Output intervals
  * @param start Start diagonal
  * @param end End diagonal
  * @param d_overlap Number of diagonals to overlap
  * @param ad Antidiagonal index
  * @param d_first First diagonal index
  * @param d_last Last diagonal index
- * @return Triplex region interval
+ * @return 0 on success, -1 if the output failed to grow
  */
-static inline intv_t *triplex_region(int start, int end, int d_overlap, int ad, int d_first, int d_last)
+static inline int triplex_region(intv_buf_t *out, int start, int end, int d_overlap, int ad, int d_first, int d_last)
 {
 	start -= d_overlap;
 	if (start < d_first)
@@ -384,22 +973,107 @@ static inline intv_t *triplex_region(int start, int end, int d_overlap, int ad,
 	if (end > d_last)
 		end = d_last;
 	
-	return new_intv(d_to_start(ad, start), d_to_end(ad, end));
+	return intv_buf_push(out, d_to_start(ad, start), d_to_end(ad, end));
+}
+
+
+/**
+ * Check if a diagonal can still reach minimal score without indels
+ * Future cells of the diagonal pair bases of the piece mirrored around
+ * the diagonal, so their best bonuses are summed until min_score is
+ * reached or the diagonal ends.
+ * @param b Score bound
+ * @param d Diagonal
+ * @param ad Current antidiagonal
+ * @param score Score of the diagonal
+ * @return Nonzero if min_score can be reached
+ */
+static int diag_alive(const t_bound *b, int d, int ad, int score)
+{
+	int need = b->min_score - score;
+	int a = ad + 1 + ((d + ad) & 1);  // Next antidiagonal of the diagonal
+	int i = (d + a - 1) / 2, l = i - a;
+	
+	for (; need > 0 && a <= b->last_ad && l >= 0; a += 2, i++, l--)
+	{
+		if (i >= b->rows)
+		// Continues in the next piece
+			return b->cont;
+		need -= b->bonus[b->piece[i]*NBASES + b->piece[l]];
+	}
+	return need <= 0;
+}
+
+
+/**
+ * Find the first diagonal over or under the pruning treshold
+ * Scores between treshold and b->sure are checked by diag_alive.
+ * @see dstate_find
+ * @param ds Diagonal state
+ * @param d First diagonal to check
+ * @param d_last Last diagonal to check
+ * @param ad Current antidiagonal
+ * @param treshold Pruning treshold
+ * @param b Score bound
+ * @param d_lo Diagonals below d_lo count as over the treshold
+ * @param d_hi Diagonals above d_hi count as over the treshold
+ * @param over Find diagonal over the treshold if nonzero, under otherwise
+ * @return Diagonal number or d_last+1 if there is none
+ */
+static inline int find_diag(
+	t_dstate *ds, int d, int d_last, int ad, int treshold, const t_bound *b,
+	int d_lo, int d_hi, int over)
+{
+	int end = (d_last < d_hi) ? d_last : d_hi;
+	int score;
+	
+	if (over)
+	{// Diagonal d_hi+1 is over the treshold, so end+1 is correct
+		if (d < d_lo || d > d_hi)
+			return d;
+		for (;; d++)
+		{
+			d = dstate_find(ds, d, end, treshold, 1);
+			if (d > end)
+				return d;
+			score = DS_GET(ds, score, DS_IDX(ds, d));
+			if (score >= b->sure || diag_alive(b, d, ad, score))
+				return d;
+		}
+	}
+	if (d < d_lo)
+		d = d_lo;
+	for (; d <= end; d++)
+	{
+		d = dstate_find(ds, d, end, b->sure, 0);
+		if (d > end)
+			break;
+		score = DS_GET(ds, score, DS_IDX(ds, d));
+		if (score < treshold || !diag_alive(b, d, ad, score))
+			return d;
+	}
+	return d_last + 1;
 }
 
 
 /**
  * Get intervals whic still need computation
+ * Runs of diagonals over and under the treshold are found by dstate_find,
+ * the state machine below moves from one run to the next one.
  * @param ad Current antidiagonal index
  * @param n_adiag Number of antidiagonal
- * @param adiag Antidiagonal  
+ * @param ds Diagonal state
  * @param region Regions to analyze on diagonal
+ * @param out Output intervals which still need computation
  * @param treshold Minimal score for intervals that still need further computation 
- * @return Intervals which still need computation
+ * @param b Score bound of diagonals over the treshold
+ * @param d_lo Diagonals below d_lo are not known and count as triplex forming
+ * @param d_hi Diagonals above d_hi are not known and count as triplex forming
+ * @return 0 on success, -1 if the output failed to grow
  */
-intv_t *get_triplex_regions(
-	int ad, int n_adiag, t_diag *diag,
-	intv_t *region, int treshold)
+int get_triplex_regions(
+	int ad, int n_adiag, t_dstate *ds, const intv_buf_t *region,
+	intv_buf_t *out, int treshold, const t_bound *b, int d_lo, int d_hi)
 {
 	/* Illustration of diagonal and antidiagonal numbers
 	 * 
@@ -432,111 +1106,207 @@ intv_t *get_triplex_regions(
 	/* Minimal gap between two triplex forming regions */
 	int min_gap = 3*d_overlap;
 	
-	int d, gap_len, d_last, d_first, start, end;
+	int d, next, gap_len, d_last, d_first, start, end;
 	ad_states_t state;
-	intv_t *tmp;
-	
-	// Create first empty interval as a list header
-	intv_t header = {0, 0, NULL};
-	intv_t *last = &header;
 	
 #ifndef NDEBUG
 	int triplex = 0;
 #endif
 	
-	while (region != NULL)
+	out->size = 0;
+	for (int k = 0; k < region->size; k++)
 	{
-		d_first = ad + 2*region->start; // First diagonal
-		d_last = 2*(region->end + 1) - ad; // Last diagonal
+		d_first = ad + 2*region->start[k]; // First diagonal
+		d_last = 2*(region->end[k] + 1) - ad; // Last diagonal
 		
 		state = S_AD_INIT;
 		start = d_first; // Interval start diagonal
 		end = d_last; // Interval end diagonal
 		gap_len = 0;
-	
+		
+#ifndef NDEBUG
+		for (d = d_first; d <= d_last; d++)
+		{
+			if (d < d_lo || d > d_hi || DS_GET(ds, score, DS_IDX(ds, d)) >= treshold)
+				triplex++;
+		}
+#endif
+		
 		/* Finite-state automata, that looks for regions
 		 * with score higher or equal to treshold.
 		 * Such regions are extended by d_overlap on both sides if possible.
 		 * See triplex_region function for details. */
-		for (d = d_first; d <= d_last; d++)
+		for (d = d_first; d <= d_last; d = next + 1)
 		{
-#ifndef NDEBUG
-			if (diag[d].score >= treshold)
-				triplex++;
-#endif
 			switch (state)
 			{
 				case S_AD_INIT:
-				// Initial decision
-					if (diag[d].score >= treshold)
-					{
-						start = d;
-						state = S_AD_TRIPLEX;
+				case S_AD_GAP:
+				// Skip diagonals under treshold
+					next = find_diag(ds, d, d_last, ad, treshold, b, d_lo, d_hi, 1);
+					if (next > d_last)
+						break;
+					if (state == S_AD_GAP)
+					{// Export triplex interval
+						if (triplex_region(out, start, end, d_overlap, ad, d_first, d_last))
+							return -1;
 					}
+					start = next;
+					state = S_AD_TRIPLEX;
 					break;
 				case S_AD_TRIPLEX:
 				// Triplex forming region
-					if (diag[d].score < treshold)
-					{
-						end = d - 1;
-						gap_len = 1;
-						state = S_AD_MIN_GAP;
-					}
+					next = find_diag(ds, d, d_last, ad, treshold, b, d_lo, d_hi, 0);
+					if (next > d_last)
+						break;
+					end = next - 1;
+					gap_len = 1;
+					state = S_AD_MIN_GAP;
 					break;
 				case S_AD_MIN_GAP:
 				// Check if the gap is at least min_gap long
-					if (diag[d].score < treshold)
-					{
-						gap_len++;
-						
-						if (gap_len == min_gap)
-							state = S_AD_GAP;
+					next = find_diag(ds, d, d_last, ad, treshold, b, d_lo, d_hi, 1);
+					gap_len += next - d;
+					if (gap_len >= min_gap)
+					{// The gap is long enough, continue by the next triplex
+						state = S_AD_GAP;
+						next--;
 					}
-					else
+					else if (next <= d_last)
 						state = S_AD_TRIPLEX;
 					break;
-				case S_AD_GAP:
-				// The gap is long enough
-					if (diag[d].score >= treshold)
-					{// Export triplex interval
-						last->next = triplex_region(start, end, d_overlap, ad, d_first, d_last);
-						last = last->next;
-						start = d;
-						state = S_AD_TRIPLEX;
-					}
-					break;
 			}
 		}
+		if (d_last >= d_hi)
+		{// Unknown diagonals behind the region continue it
+			if (state == S_AD_GAP &&
+			    triplex_region(out, start, end, d_overlap, ad, d_first, d_last))
+				return -1;
+			if (state == S_AD_INIT || state == S_AD_GAP)
+				start = d_last + 1;
+			end = d_last;
+			state = S_AD_TRIPLEX;
+		}
+		if (state == S_AD_TRIPLEX)
+		// The last triplex reaches the end, end is set only by a gap
+			end = d_last;
+		
 		if (state == S_AD_TRIPLEX ||
 			state == S_AD_MIN_GAP ||
 			state == S_AD_GAP)
 		{// Export last triplex interval
-			last->next = triplex_region(start, end, d_overlap, ad, d_first, d_last);
-			last = last->next;
+			if (triplex_region(out, start, end, d_overlap, ad, d_first, d_last))
+				return -1;
 		}
-		tmp = region;
-		region = region->next;
-		free(tmp);
 	}
 	
 #ifndef NDEBUG
 	printf("Possible triplexes: %d\n", triplex);
 	
 	/* Debug print */
-	intv_t *intv = header.next;
-	
 	int width = 0;
-	int count = 0;
-	while (intv != NULL)
+	for (int k = 0; k < out->size; k++)
+		width += out->end[k] - out->start[k] + 1;
+	
+	printf("Adiag: %d, treshold: %d, number of intervals: %d, average interval width: %g\n",
+	       ad, treshold, out->size, (double) width/out->size);
+#endif
+	return 0;
+}
+
+
+/**
+ * Initialize pruning controller
+ * Ratio of pruned cells to cells under treshold grows with the ratio of
+ * cells under treshold. Regions are separated only by gaps of at least
+ * three times their margin, so they hardly split if the ratio is lower
+ * than PRUNE_MIN_RATIO. Initial estimate of the growth was deduced
+ * empirically. All cells under treshold have an extra bucket, whole
+ * regions are pruned then.
+ * @param pc Pruning controller
+ */
+static void prune_init(t_prune *pc)
+{
+	for (int b = 0; b < PRUNE_BUCKETS; b++)
 	{
-		width += intv->end - intv->start + 1;
-		count++;
-		intv = intv->next;
+		double x = ((b + 0.5) / PRUNE_BUCKETS - PRUNE_MIN_RATIO) / (1 - PRUNE_MIN_RATIO);
+		pc->eff[b] = (x > 0) ? x*x : 0;
 	}
-	printf("Adiag: %d, treshold: %d, number of intervals: %d, average interval width: %g\n",
-	       ad, treshold, count, (double) width/count);
+	pc->eff[PRUNE_BUCKETS] = 1;
+	pc->under = 0;
+	pc->bucket = 0;
+	pc->predicted = 0;
+}
+
+
+/**
+ * Get cost of pruning of triplex regions in computed cells
+ * @param count Number of cells of the antidiagonal
+ * @return Cost of scans of diagonals of both parities
+ */
+static inline double prune_cost(int count)
+{
+	return PRUNE_SCAN_COST * 2*count + PRUNE_CALL_COST;
+}
+
+
+/**
+ * Decide to prune triplex regions after an antidiagonal
+ * Pruning pays off, if the cells it is expected to prune outweigh its
+ * cost within PRUNE_HORIZON antidiagonals. Later the cells would be
+ * pruned by the next pruning anyway.
+ * @param pc Pruning controller
+ * @param left Number of antidiagonals computed after the pruning
+ * @param count Number of computed cells of the antidiagonal
+ * @param under Number of cells under treshold
+ * @return 1 to prune the regions, 0 otherwise
+ */
+static int prune_update(t_prune *pc, int left, int count, int under)
+{
+	int h = (left < PRUNE_HORIZON) ? left : PRUNE_HORIZON;
+	int b = (int) ((double) under * PRUNE_BUCKETS / count);
+	
+	pc->under = under;
+	pc->bucket = (b < PRUNE_BUCKETS || under == count) ? b : PRUNE_BUCKETS - 1;
+	pc->predicted = (int) (pc->eff[pc->bucket] * under);
+	
+	return h > 0 && (double) pc->predicted * h >= prune_cost(count);
+}
+
+
+/**
+ * Learn from realized pruning
+ * @param pc Pruning controller
+ * @param count Number of cells of the antidiagonal before pruning
+ * @param kept Number of cells kept by pruning
+ */
+static void prune_done(t_prune *pc, int count, int kept)
+{
+	double *eff = &pc->eff[pc->bucket];
+	double real = (pc->under > 0) ? (double) (count - kept) / pc->under : 0;
+	
+	/* Moving average of the realized ratio */
+	*eff = (*eff + real) / 2;
+	if (*eff < PRUNE_MIN_EFF)
+		*eff = PRUNE_MIN_EFF;
+}
+
+
+/**
+ * Print a line of the pruning trace, @see t_params
+ * Lines of concurrent searches are not interleaved.
+ * @param format Format string of the line
+ */
+static void print_trace(const char *format, ...)
+{
+	va_list args;
+	
+	va_start(args, format);
+#ifdef _OPENMP
+	#pragma omp critical (triplex_trace)
 #endif
-	return header.next;
+	REvprintf(format, args);
+	va_end(args);
 }
 
 
@@ -545,150 +1315,144 @@ intv_t *get_triplex_regions(
  * @param piece Given sequence
  * @param piece_l Length of given sequence
  * @param offset Offset from the real start of sequence
- * @param seq_len Sequence length
- * @param seq_type Sequence type (prok, euka)
+ * @param pv P-value table of the triplex type
  * @param n_antidiag Number of antidiagonals to compute
  * @param max_bonus Maximal bonus per match
- * @param diag t_diag array used to search for triplexes
+ * @param ds Diagonal state used to search for triplexes
+ * @param kern Antidiagonal kernel, @see kernel_select
  * @param params Application parameters
  * @param pen Penalization scores
- * @param pb Progress bar
+ * @param buf Result buffer
+ * @param regions Two interval arrays for triplex regions
+ * @param head Piece starts its chunk
+ * @param tail Piece ends its chunk
+ * @param stream Piece of a stream or NULL, @see search_stream_task
+ * @param sweep Sweep marked by the cells or NULL, @see sweep_mark
  */
 void search(
-	char *piece, int piece_l, int offset, int seq_len, int seq_type, int n_antidiag,
-	int max_bonus, t_diag *diag, t_params *params, t_penalization *pen, prog_t *pb)
+	char *piece, int piece_l, int64_t offset, const t_pvalue *pv, int n_antidiag,
+	int max_bonus, t_dstate *ds, const t_kernel *kern, t_params *params,
+	t_penalization *pen, t_dl_buf *buf, intv_buf_t *regions, int head, int tail,
+	t_stream *stream, t_sweep *sweep)
 {
-	int i, ad, d, length, treshold, d_count, d_under_tres, ad_start;
-	double tres_ratio;
+	int i, k, ad, d_count, d_under_tres, ad_start, first, d_first, d_end, prune, kept;
+	int row0 = (stream != NULL) ? stream->row0 : 0;
+	int cont = (stream != NULL) ? stream->cont : 0;
+	t_prune pc;
+	t_bound bound = {
+		piece, piece_l, cont, n_antidiag - 1, params->min_score, 0, {0}
+	};
+	
+	/* Triplexes continue into the previous or the next piece of the chunk,
+	 * unless the piece ends it, @see get_pieces */
+	t_kctx ctx = {
+		piece, head ? 0 : -1, (cont || !tail) ? -1 : piece_l - 1, offset, pv,
+		0, params, pen, kern, ds, buf
+	};
 	
 	// Starting antidiagonal
 	ad_start = params->min_loop + 1;
 	
-	if (piece_l < n_antidiag)
+	if (!cont && piece_l < n_antidiag)
 		n_antidiag = piece_l;
 	
-	intv_t *triplex_regions = new_intv(0, piece_l - 1);
-	intv_t *intv = NULL;
+	intv_buf_t *triplex_regions = &regions[0], *next_regions = &regions[1], *tmp;
+	
+	triplex_regions->size = 0;
+	intv_buf_push(triplex_regions, 0, piece_l - 1);
+	
+	prune_init(&pc);
+	
+	for (i = 0; i < NBASES*NBASES; i++)
+	{// Match bonus including isogroup stay, scores may exceed the kernel tables
+		int score = TAB_SCORE[params->tri_type][i / NBASES][i % NBASES];
+		int bonus = score + ((pen->iso_stay > 0) ? pen->iso_stay : 0);
+		bound.bonus[i] = (score > TM && bonus > 0) ? bonus : 0;
+	}
 	
 	/* ad = antidiagonal number */
 	for (ad = ad_start; ad < n_antidiag; ad++)
 	{
-		intv = triplex_regions;
 		d_count = 0;
 		d_under_tres = 0;
 		
 		/* Minimal score to still have a chance to satisfy min_score param
 		 * at the maximal antidiagonal. */
-		treshold = params->min_score - (n_antidiag - ad + 1)/2 * max_bonus;
+		ctx.treshold = params->min_score - (n_antidiag - ad + 1)/2 * max_bonus;
 		
-		while (intv != NULL)
+		for (k = 0; k < triplex_regions->size; k++)
 		{
-			for (i = ad + intv->start, d = ad + 2*intv->start + 1;
-			     i <= intv->end;
-			     i++, d += 2)
+			/* Max score calculation, status update and export
+			 * of finished triplexes for all cells of the interval */
+			int end = triplex_regions->end[k];
+			
+			first = (ad + triplex_regions->start[k] > row0) ? ad + triplex_regions->start[k] : row0;
+			if (first <= end)
 			{
-				/* Max score and length calcualtion */
-				get_max_score(
-					piece[i], piece[i-ad],
-					&diag[d-1], &diag[d], &diag[d+1],
-					d, ad, params->tri_type, params->max_loop, pen
-				);
-				length = get_length(
-					diag[d].start.antidiag,
-					diag[d].max_score_pos.antidiag,
-					diag[d].max_indels
-				);
-				diag[d].status = (length >= params->min_len) ? diag[d].status|STAT_MINLEN : diag[d].status&(~STAT_MINLEN);
-				
-				/* Actual score satisfies the required quality */
-				if (diag[d].score >= params->min_score)
-				{
-					diag[d].status |= STAT_QUALITY;
-					/* If triplex can not continue, then export */
-					if ((diag[d].status & STAT_MINLEN) && ((d == (ad+1)) || (d == (2*piece_l-ad-1))))
-					{
-						diag[d].status = STAT_EXPORT;
-						if (p_value(diag[d].max_score, params->tri_type, seq_len, seq_type) <= params->p_val)
-						{
-							export_data(diag[d], params->tri_type, offset, seq_len, seq_type);
-						}
-					}
-				}
-				/* Actual score does not satisfy the required quality */
-				else
-				{
-				/* If quality requirement was satisfied in previous step, then export */
-					if(
-						(!(diag[d-1].status & STAT_QUALITY)) && (!(diag[d+1].status & STAT_QUALITY)) &&
-						((diag[d].status & STAT_QUALITY)) && ((diag[d].status & STAT_MINLEN)))
-					{
-						diag[d].status = STAT_EXPORT;
-						if (p_value(diag[d].max_score, params->tri_type, seq_len, seq_type) <= params->p_val)
-						{
-							export_data(diag[d], params->tri_type, offset, seq_len, seq_type);
-						}
-						diag[d].max_score = 0;
-					}
-					else {
-						diag[d].status = STAT_NONE;
-					}
-				}
-				d_count++;
-				
-				if (diag[d].score < treshold)
-					d_under_tres++;
+				d_under_tres += kern->step(&ctx, ad, first, end);
+				d_count += end - first + 1;
+				if (sweep != NULL)
+					sweep_mark(
+						sweep, ds, DS_IDX(ds, 2*first - ad + 1), ad,
+						offset + first, end - first + 1
+					);
 			}
-			intv = intv->next;
 		}
 		
-		tres_ratio = (double) d_under_tres / d_count;
-		
-		if (tres_ratio >= TRES_RATIO)
+		prune = d_count > 0 && prune_update(&pc, n_antidiag - ad - 1, d_count, d_under_tres);
+		if (params->trace)
+			print_trace("prune %lld %d %d %d %d %d\n",
+			            (long long) offset, ad, d_count, d_under_tres, pc.predicted, prune);
+		if (prune)
 		{
-			triplex_regions = get_triplex_regions(ad, n_antidiag, diag, triplex_regions, treshold);
-#if 0
-			intv = tr;
-			d_in_regions = 0;
+			/* Every indel costs an antidiagonal without bonus, so scores
+			 * over sure reach min_score also with indels. The others reach
+			 * it only without them, @see diag_alive. */
+			bound.sure = params->min_score - ((n_antidiag - ad - 1)/2 * max_bonus - pen->insertion);
+			if (bound.sure < ctx.treshold)
+				bound.sure = ctx.treshold;
 			
-			while (intv != NULL)
+			/* Rows computed by the previous piece and rows of the next
+			 * one are not known, so they can not prune the regions.
+			 * Regions are kept if the new ones do not fit memory. */
+			if (get_triplex_regions(
+				ad, n_antidiag, ds, triplex_regions, next_regions, ctx.treshold,
+				&bound, 2*row0 - ad + 1, cont ? 2*piece_l - ad : INT_MAX) == 0)
 			{
-				for (i = ad + intv->start; i <= intv->end; i++)
-					d_in_regions++;
-				
-				intv = intv->next;
+				tmp = triplex_regions;
+				triplex_regions = next_regions;
+				next_regions = tmp;
 			}
-			real_ratio = (double) (d_count - d_in_regions) / d_count;
 			
-			fprintf(fd, "%d %g %g\n", ad, tres_ratio, real_ratio);
-#endif
+			/* Cells of the antidiagonal kept by the regions */
+			kept = 0;
+			for (k = 0; k < triplex_regions->size; k++)
+			{
+				first = (ad + triplex_regions->start[k] > row0) ? ad + triplex_regions->start[k] : row0;
+				if (first <= triplex_regions->end[k])
+					kept += triplex_regions->end[k] - first + 1;
+			}
+			prune_done(&pc, d_count, kept);
+			if (params->trace)
+				print_trace("pruned %lld %d %d %d\n", (long long) offset, ad, d_count - kept, triplex_regions->size);
 #ifndef NDEBUG
 			int triplex = 0;
-			for (d = ad; d <= 2*piece_l - ad; d++)
+			for (int d = ad; d <= 2*piece_l - ad; d++)
 			{
-				if (diag[d].score >= treshold)
+				if (DS_GET(ds, score, DS_IDX(ds, d)) >= ctx.treshold)
 					triplex++;
 			}
 			printf("Real possible triplexes: %d\n", triplex);
 #endif
 		}
 	}
-	// Free last version of triplex regions
-	free_intv(triplex_regions);
-	
-	if (pb->max >= PB_SHOW_LIMIT)
-	{// Redraw progress bar
-// 		ad_perc = (ad+1 - ad_start) / ad_width;
-// 		set_txt_progress_bar(pb, offset + ad_perc * piece_l);
-		set_txt_progress_bar(pb, offset + piece_l);
-	}
-	
-	/* Print nonexported triplexes */
-	for (i = 1; i < (2*piece_l); i++)
+	/* Print nonexported triplexes, diagonals with cells in the previous
+	 * or the next piece are finished by that piece */
+	d_first = head ? 1 : n_antidiag - 1;
+	d_end = (cont || !tail) ? 2*piece_l + 2 - n_antidiag : 2*piece_l;
+	for (i = d_first; i < d_end; i++)
 	{
-		if ((diag[i].status & STAT_QUALITY) && (diag[i].status & STAT_MINLEN))
-		{
-			if (p_value(diag[i].max_score, params->tri_type, seq_len, seq_type) <= params->p_val)
-				export_data(diag[i], params->tri_type, offset, seq_len, seq_type);
-		}
+		if ((ds->flags[DS_IDX(ds, i)] & STAT_QUALITY) && (ds->flags[DS_IDX(ds, i)] & STAT_MINLEN))
+			export_diag(&ctx, i);
 	}
 }
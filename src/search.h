@@ -14,20 +14,79 @@
 #include "search_interface.h"
 #include "libtriplex.h"
 #include "interval.h"
+#include "progress.h"
+#include "dl_list.h"
+#include "sweep.h"
 
-#define MAX_PIECE_SIZE (10*1024)
+/* Maximal number of rows of a piece, @see get_piece_size */
+#define MAX_PIECE_SIZE (1024*1024)
 
-/* Treshold ratio for triplex regions analysis start,
- * deduced empirically */
-#define TRES_RATIO 0.93
+/* Maximal bytes of a piece and its DP state given by R, @see get_tune */
+#define MAX_CACHE_BUDGET (1L << 30)
+
+/* Minimal ratio of piece size to its overlap */
+#define PIECE_OVERLAP_RATIO 16
+
+/* Cost of scanning one diagonal by get_triplex_regions and fixed cost
+ * of its call in computed cells, measured with SSE2 kernels,
+ * @see prune_update */
+#define PRUNE_SCAN_COST 0.35
+#define PRUNE_CALL_COST 64
+
+/* Number of antidiagonals, which pruned cells are counted for */
+#define PRUNE_HORIZON 3
+
+/* Buckets of ratio of cells under treshold, which learn the ratio
+ * of pruned cells separately, @see prune_init */
+#define PRUNE_BUCKETS 32
+
+/* Ratio of cells under treshold, which hardly prunes regions,
+ * and minimal learned ratio of pruned cells */
+#define PRUNE_MIN_RATIO 0.88
+#define PRUNE_MIN_EFF   (1.0/64)
+
+/* Number of scores of P-value table computed by get_min_score,
+ * the table grows if the minimal score is higher */
+#define PVALUE_INIT_SIZE 64
+
+/* Number of triplex regions preallocated for every thread,
+ * @see get_triplex_regions */
+#define REGIONS_INIT_SIZE 256
+
+/* Minimal number of pieces per thread to search all types of
+ * a piece by one task, @see main_search */
+#define FUSED_MIN_PIECES 4
+
+typedef struct
+{// Piece of a chunk searched as one unit of work
+	int64_t offset;  /* Piece offset in sequence */
+	int64_t len;     /* Piece length including overlap, whole chunk if streamed */
+	int64_t step;    /* Progress made by the piece */
+	int type;        /* Index of searched type */
+	int min_ad;      /* First antidiagonal of the piece, @see get_seed_chunks */
+	int n_antidiag;  /* Number of antidiagonals of the piece */
+	int head;        /* Piece starts its chunk */
+	int tail;        /* Piece ends its chunk */
+	int worker;      /* Thread which searched the piece */
+	int64_t first;   /* First piece result in the worker result buffer */
+	int64_t count;   /* Number of piece results */
+} t_piece;
+
+typedef struct
+{// Piece size tuning, unset options are filled in by main_search
+	int piece_size;  /* Number of rows of a piece, 0 to choose automatically */
+	long budget;     /* Bytes of a piece and its DP state, 0 to derive from L2 cache */
+} t_tune;
 
 extern double RN[NUM_SEQ_TYPES][NUM_TRI_TYPES];
 extern double LAMBDA[NUM_SEQ_TYPES][NUM_TRI_TYPES];
 extern double MI[NUM_SEQ_TYPES][NUM_TRI_TYPES];
 
 void main_search(
-	seq_t dna, intv_t *chunk, t_params *params, t_penalization *pen, int pbw
+	seq_t dna, intv_t *chunk, t_params *params, int ntypes, t_penalization *pen,
+	prog_t *pb, t_dl_list *list, int nthreads, t_tune *tune, t_sweep *sweep
 );
-int get_min_score(double pvalue, int type, int seq_len, int seq_type);
+int get_min_score(double pvalue, int type, int64_t seq_len, int seq_type);
+void set_min_score(t_params *params, int64_t seq_len, int seq_type);
 
 #endif // SEARCH_H
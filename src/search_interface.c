@@ -10,6 +10,10 @@
 
 #include <ctype.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "IRanges_interface.h"
 #include "XVector_interface.h"
 #include "Biostrings_interface.h"
@@ -18,11 +22,11 @@
 #include "search.h"
 #include "libtriplex.h"
 #include "dl_list.h"
+#include "sweep.h"
 
 
 /* Global Variable  */
 t_dl_list dl_list, dl_list_arr[8];
-int act_dl_list;
 
 
 
@@ -342,43 +346,45 @@ void set_score_group_tables(
 }
 
 
+/* Code of every XRaw byte of DNAString objects, @see decode_DNAString */
+static char RAW2NUKL[UINT8_MAX + 1];
+
+/* Supported symbols of the DNA alphabet */
+static const char DNA_SYMBOLS[] = "ACGTMRWSYKVHDBN-";
+
+
 /**
  * Decode DNAString object
+ * Bytes of the object are not copied, pieces are decoded just before
+ * their search, @see seq_decode. The object must stay protected.
  * @see IRanges_interface, Biostrings_interface
  * @param dnaobject DNAString object
  * @param seq_type Sequence type
- * @return Decoded sequence structure
+ * @return Encoded sequence structure
  */
 seq_t decode_DNAString(SEXP dnaobject, int seq_type)
 {
 	// Extract char sequence from R object
 	Chars_holder x = hold_XRaw(dnaobject);
-	// Initialize structure for decoded string
-	seq_t dna;
-	dna.len = x.length;
-	dna.seq = malloc((x.length + 1) * sizeof(char));
-	if (dna.seq == NULL)
-		error("Failed to allocate memory for decoded DNA string.");
 	
-	int i; char ch;
+	for (int i = 0; i <= UINT8_MAX; i++)
+		RAW2NUKL[i] = INVALID_CHAR;
+	for (const char *sym = DNA_SYMBOLS; *sym != '\0'; sym++)
+		RAW2NUKL[(uint8_t) DNAencode(*sym)] = CHAR2NUKL[tolower(*sym)];
 	
-	for (i = 0; i < dna.len; i++)
+	// Initialize structure for encoded string
+	seq_t dna;
+	seq_init(&dna, x.ptr, RAW2NUKL, x.length, seq_type);
+	
+	int64_t bad = 0;
+	int res = seq_scan(&dna, &bad);
+	if (res != 0)
 	{
-		ch = CHAR2NUKL[tolower(DNAdecode(x.ptr[i]))];
-		if (ch == INVALID_CHAR)
-		{
-			free(dna.seq);
-			error("Unsupported symbol '%c' in input sequence.", dna.seq[i]);
-		}
-		else
-		{
-			dna.seq[i] = ch;
-		}
+		seq_free(&dna);
+		if (res < 0)
+			error("Failed to allocate memory for decoded DNA string.");
+		error("Unsupported symbol '%c' in input sequence.", DNAdecode(x.ptr[bad]));
 	}
-	
-	dna.seq[i] = '\0';
-	dna.type = seq_type;
-	
 	return dna;
 }
 
@@ -391,7 +397,7 @@ seq_t decode_DNAString(SEXP dnaobject, int seq_type)
  * @param len Vector length
  * @return Vector object
  */
-SEXP create_list_elt(SEXP list, int idx, SEXPTYPE type, int len)
+SEXP create_list_elt(SEXP list, int idx, SEXPTYPE type, R_xlen_t len)
 {
 	SEXP vector;
 	PROTECT(vector = allocVector(type, len));
@@ -403,30 +409,37 @@ SEXP create_list_elt(SEXP list, int idx, SEXPTYPE type, int len)
 
 /**
  * Export results in list object
+ * Positions are exported as doubles, which hold them exactly
+ * also in sequences longer than the range of R integers.
  * @param dl_list List pointer
+ * @param tune Piece size options used by the search
  * @return List object
  */
-SEXP export_results(t_dl_list *dl_list)
+SEXP export_results(t_dl_list *dl_list, t_tune *tune)
 {
 	t_dl_node *pointer;
 	SEXP list;
-	PROTECT(list = allocVector(VECSXP, 9));
+	PROTECT(list = allocVector(VECSXP, 10));
 	
-	int *start = INTEGER(create_list_elt(list, 0, INTSXP, dl_list->size));
-	int *end = INTEGER(create_list_elt(list, 1, INTSXP, dl_list->size));
+	double *start = REAL(create_list_elt(list, 0, REALSXP, dl_list->size));
+	double *end = REAL(create_list_elt(list, 1, REALSXP, dl_list->size));
 	int *score = INTEGER(create_list_elt(list, 2, INTSXP, dl_list->size));
 	double *pvalue = REAL(create_list_elt(list, 3, REALSXP, dl_list->size));
 	int *insdel = INTEGER(create_list_elt(list, 4, INTSXP, dl_list->size));
 	int *type = INTEGER(create_list_elt(list, 5, INTSXP, dl_list->size));
-	int *lstart = INTEGER(create_list_elt(list, 6, INTSXP, dl_list->size));
-	int *lend = INTEGER(create_list_elt(list, 7, INTSXP, dl_list->size));
+	double *lstart = REAL(create_list_elt(list, 6, REALSXP, dl_list->size));
+	double *lend = REAL(create_list_elt(list, 7, REALSXP, dl_list->size));
 	int *strand = INTEGER(create_list_elt(list, 8, INTSXP, dl_list->size));
+	int *tuning = INTEGER(create_list_elt(list, 9, INTSXP, 2));
+	
+	tuning[0] = tune->piece_size;
+	tuning[1] = tune->budget;
 	
 	pointer = (dl_list->first)->next;
 	
 	/* printf("List size: %d\n", dl_list->size); */
 	
-	for (int i = 0; i < dl_list->size; i++)
+	for (int64_t i = 0; i < dl_list->size; i++)
 	{
 		/* printf("(%d,%d)", pointer->data.start, pointer->data.end); */
 		start[i] = pointer->data.start;
@@ -453,6 +466,7 @@ SEXP export_results(t_dl_list *dl_list)
 
 /**
  * Save result
+ * @param buf    Result buffer of search thread
  * @param start  Start of triplex
  * @param end    End of triplex
  * @param score  Triplex score
@@ -463,8 +477,8 @@ SEXP export_results(t_dl_list *dl_list)
  * @param lend   Loop end
  */
 void save_result(
-	int start, int end, int score, double pvalue, int insdel,
-	int type,  int lstart, int lend, int strand)
+	t_dl_buf *buf, int64_t start, int64_t end, int score, double pvalue,
+	int insdel, int type, int64_t lstart, int64_t lend, int strand)
 {
 	t_dl_data data =
 	{
@@ -478,7 +492,7 @@ void save_result(
 		.lend = lend,
 		.strand = strand 
 	};
-	dl_list_insert(&dl_list_arr[act_dl_list], data);
+	dl_buf_push(buf, data);
 }
 
 
@@ -505,6 +519,133 @@ void set_lambda_mu_rn_tables(double *p)
 }
 
 
+/**
+ * Get algorithm options from R parameter vector
+ * @param p Parameter vector
+ * @return Options, tri_type is not set
+ */
+static t_params get_params(double *p)
+{
+	t_params params =
+	{// Set params
+		.tri_type = -1,
+		.min_score = p[P_MIN_SCORE],
+		.p_val = p[P_P_VALUE],
+		.min_len = p[P_MIN_LEN],
+		.max_len = p[P_MAX_LEN],
+		.min_loop = p[P_MIN_LOOP],
+		.max_loop = p[P_MAX_LOOP],
+		.stream = p[P_STREAM],
+		.seed_len = p[P_SEED_LEN],
+		.trace = p[P_TRACE],
+		.prefilter = p[P_PREFILTER],
+		.seed_band = p[P_SEED_BAND]
+	};
+	return params;
+}
+
+
+/**
+ * Get penalizations from R parameter vector
+ * @param p Parameter vector
+ * @return Penalizations
+ */
+static t_penalization get_penalization(double *p)
+{
+	t_penalization pen =
+	{// Set penalizations 
+		.dtwist = p[P_DTWIST_PEN],
+		.insertion = p[P_INS_PEN],
+		.iso_change = p[P_ISO_PEN],
+		.iso_stay = p[P_ISO_BONUS],
+		.mismatch = p[P_MIS_PEN]
+	};
+	return pen;
+}
+
+
+/**
+ * Get piece size tuning from R parameter vector
+ * Explicit options are bounded, so sizes derived from them fit int.
+ * @param p Parameter vector
+ * @return Piece size options, zero values are chosen by main_search
+ */
+static t_tune get_tune(double *p)
+{
+	t_tune tune = {0, 0};
+	
+	if (p[P_PIECE_SIZE] > 0)
+		tune.piece_size = (p[P_PIECE_SIZE] < MAX_PIECE_SIZE) ? p[P_PIECE_SIZE] : MAX_PIECE_SIZE;
+	if (p[P_CACHE_BUDGET] > 0)
+		tune.budget = (p[P_CACHE_BUDGET] < MAX_CACHE_BUDGET) ? p[P_CACHE_BUDGET] : MAX_CACHE_BUDGET;
+	
+	return tune;
+}
+
+
+/**
+ * Get number of search threads from R parameter vector
+ * @param p Parameter vector
+ * @return Number of threads
+ */
+static int get_threads(double *p)
+{
+	int nthreads = p[P_THREADS];
+
+#ifndef _OPENMP
+	nthreads = 1; // Built without OpenMP support
+#endif
+	if (nthreads < 1)
+		nthreads = 1;
+	
+	return nthreads;
+}
+
+
+/**
+ * Print searched types
+ * @param t Triplex type vector
+ * @param ntypes Number of types
+ * @param nthreads Number of threads
+ */
+static void print_search_start(int *t, int ntypes, int nthreads)
+{
+	if (ntypes == 1)
+		Rprintf("Searching for triplex type %d", t[0]);
+	else
+	{
+		Rprintf("Searching for triplex types");
+		for (int i = 0; i < ntypes; i++)
+			Rprintf(i == 0 ? " %d" : ", %d", t[i]);
+	}
+	if (nthreads > 1)
+		Rprintf(" using %d threads", nthreads);
+	Rprintf("...\n");
+}
+
+
+/**
+ * Export results of all types in sequence order
+ * @param list Result list for every type, freed
+ * @param tune Piece size options used by the search
+ * @return List object
+ */
+static SEXP search_results(t_dl_list *list, t_tune *tune)
+{
+	SEXP res;
+	
+	dl_list_merge_sort(list, &dl_list, NUM_TRI_TYPES);
+	res = export_results(&dl_list, tune);
+	dl_list_free(&dl_list);
+	
+	for (int i = 0; i < NUM_TRI_TYPES; i++)
+	// Nodes were moved to the merged list
+		dl_list_free(&list[i]);
+	
+	return res;
+}
+
+
 /**
  * Search triplexes in DNA sequence
  * NOTE .Call entry point
@@ -527,53 +668,208 @@ SEXP triplex_search(
 	
 	double *p = REAL(rparams);
 	
-	t_params params =
-	{// Set params
-		.tri_type = -1,
-		.min_score = p[P_MIN_SCORE],
-		.p_val = p[P_P_VALUE],
-		.min_len = p[P_MIN_LEN],
-		.max_len = p[P_MAX_LEN],
-		.min_loop = p[P_MIN_LOOP],
-		.max_loop = p[P_MAX_LOOP]
-	};
+	t_params params = get_params(p);
+	t_penalization pen = get_penalization(p);
 	
-	t_penalization pen =
-	{// Set penalizations 
-		.dtwist = p[P_DTWIST_PEN],
-		.insertion = p[P_INS_PEN],
-		.iso_change = p[P_ISO_PEN],
-		.iso_stay = p[P_ISO_BONUS],
-		.mismatch = p[P_MIS_PEN]
-	};
+	t_tune tune = get_tune(p);
+	
+	int *st = INTEGER(seq_type);
+	int *t = INTEGER(type);
+	int ntypes = LENGTH(type);
+	int nthreads = get_threads(p);
+	
+	set_lambda_mu_rn_tables(p);
+	set_score_group_tables(INTEGER(st_par), INTEGER(st_apar), INTEGER(gt_par), INTEGER(gt_apar));
+	
+	seq_t dna = decode_DNAString(dnaobject, st[0]);
+	intv_t *chunk = get_chunks(dna);
+	
+	t_params tparams[NUM_TRI_TYPES];
+	
+	for (int i = 0; i < ntypes; i++)
+	{// Deduce minimal scores in type vector order, see set_min_score
+		params.tri_type = t[i];
+		set_min_score(&params, dna.len, dna.type);
+		tparams[i] = params;
+	}
+	
+	for (int i = 0; i < NUM_TRI_TYPES; i++)
+		dl_list_init(&dl_list_arr[i], p[P_MAX_LEN]+p[P_MAX_LOOP]);
+	
+	/* Initialize progress bar structure */
+	prog_t pb = {0, dna.len, *INTEGER(pbw), 0, -1};
+	
+	/* Search pieces of all types as one pool of tasks */
+	print_search_start(t, ntypes, nthreads);
+	
+	pb.max *= ntypes;
+	if (pb.max >= PB_SHOW_LIMIT)
+		set_txt_progress_bar(&pb, 0);
+	
+	main_search(dna, chunk, tparams, ntypes, &pen, &pb, dl_list_arr, nthreads, &tune, NULL);
+	
+	if (pb.max >= PB_SHOW_LIMIT)
+	{// Seeded search skips parts of the sequence
+		if (params.seed_len > 0)
+			set_txt_progress_bar(&pb, pb.max);
+		Rprintf("\n");
+	}
+	
+	list = search_results(dl_list_arr, &tune);
+	
+	seq_free(&dna);
+	free_intv(chunk);
+	
+	return list;
+}
+
+
+/**
+ * Search triplexes in DNA sequence for several parameter sets
+ * All sets are searched with the lowest minimal score, the highest
+ * P-value and the lowest min_len first. This search marks windows
+ * of cells reaching minimal scores of the other sets, which are then
+ * searched only in their windows, @see sweep.c. The results are the
+ * same as by triplex_search with every set.
+ * NOTE .Call entry point
+ * @param dnaobject DNAString object
+ * @param type      Triplex type vector
+ * @param rparams   Custom algorithm options
+ * @param sweep     Matrix of min_score, p_value and min_len of every set
+ * @param st_par Score table for parallel triplexes
+ * @param st_apar Score table for antiparallel triplexes
+ * @param gt_par Isogroup table for parallel triplexes
+ * @param gt_apar Isogroup table for antiparallel triplexes
+ * @param pbw       Progress bar width
+ * @return List of results of every set
+ */
+SEXP triplex_sweep(
+	SEXP dnaobject, SEXP type, SEXP seq_type, SEXP rparams, SEXP sweep,
+	SEXP st_par, SEXP st_apar, SEXP gt_par, SEXP gt_apar,
+	SEXP pbw)
+{
+	SEXP list, loose_list;
+	
+	double *p = REAL(rparams);
+	double *sv = REAL(sweep);
+	int nsets = LENGTH(sweep)/3;
+	int max_len = p[P_MAX_LEN] + p[P_MAX_LOOP];
+	
+	t_params params = get_params(p);
+	t_penalization pen = get_penalization(p);
+	
+	t_tune tune = get_tune(p);
 	
 	int *st = INTEGER(seq_type);
 	int *t = INTEGER(type);
+	int ntypes = LENGTH(type);
+	int nthreads = get_threads(p);
+	
+	if (nsets < 1)
+		error("No parameter sets to search.");
 	
 	set_lambda_mu_rn_tables(p);
 	set_score_group_tables(INTEGER(st_par), INTEGER(st_apar), INTEGER(gt_par), INTEGER(gt_apar));
 	
+	t_params *sets = malloc((size_t) nsets*ntypes * sizeof(t_params));
+	int *scores = malloc(nsets * sizeof(int));
+	if (sets == NULL || scores == NULL)
+		error("Failed to allocate memory for parameter sweep.");
+	
 	seq_t dna = decode_DNAString(dnaobject, st[0]);
 	intv_t *chunk = get_chunks(dna);
 	
+	t_params loose[NUM_TRI_TYPES];
+	t_sweep sw[NUM_TRI_TYPES];
+	
+	for (int i = 0; i < ntypes; i++)
+	{// Options of every set and the loosest ones of every type
+		for (int s = 0; s < nsets; s++)
+		{
+			t_params *set = &sets[s*ntypes + i];
+			
+			*set = params;
+			set->tri_type = t[i];
+			set->p_val = sv[nsets + s];
+			set->min_len = sv[2*nsets + s];
+			// Minimal score carries over in type vector order as in triplex_search
+			set->min_score = (i > 0) ? sets[s*ntypes + i - 1].min_score : sv[s];
+			set_min_score(set, dna.len, dna.type);
+			scores[s] = set->min_score;
+			
+			if (s == 0)
+				loose[i] = *set;
+			if (loose[i].min_score > set->min_score)
+				loose[i].min_score = set->min_score;
+			if (loose[i].min_len > set->min_len)
+				loose[i].min_len = set->min_len;
+			if (loose[i].p_val < set->p_val)
+				loose[i].p_val = set->p_val;
+		}
+		sweep_init(&sw[i], scores, nsets, dna.len);
+	}
+	
 	for (int i = 0; i < NUM_TRI_TYPES; i++)
-		dl_list_init(&dl_list_arr[i], p[P_MAX_LEN]+p[P_MAX_LOOP]); // FIXME
+		dl_list_init(&dl_list_arr[i], max_len);
+	
+	/* Progress bar shows the loosest search only */
+	prog_t pb = {0, dna.len, *INTEGER(pbw), 0, -1};
+	prog_t pb_none = {0, 0, *INTEGER(pbw), 0, -1};
+	
+	print_search_start(t, ntypes, nthreads);
+	
+	pb.max *= ntypes;
+	if (pb.max >= PB_SHOW_LIMIT)
+		set_txt_progress_bar(&pb, 0);
+	
+	main_search(dna, chunk, loose, ntypes, &pen, &pb, dl_list_arr, nthreads, &tune, sw);
+	
+	if (pb.max >= PB_SHOW_LIMIT)
+		Rprintf("\n");
 	
-	for (int i = 0; i < LENGTH(type); i++)
-	{// Call original main function for all specified vector types
-		act_dl_list = i;
+	PROTECT(loose_list = search_results(dl_list_arr, &tune));
+	PROTECT(list = allocVector(VECSXP, nsets));
+	
+	for (int s = 0; s < nsets; s++)
+	{
+		int same = 1;
 		
-		params.tri_type = t[i];
-		main_search(dna, chunk, &params, &pen, *INTEGER(pbw));
-		dl_list_group_filter(&dl_list_arr[i]);
+		for (int i = 0; i < ntypes; i++)
+		{
+			t_params *set = &sets[s*ntypes + i];
+			
+			if (set->min_score != loose[i].min_score ||
+			    set->min_len != loose[i].min_len || set->p_val != loose[i].p_val)
+				same = 0;
+		}
+		if (same)
+		{// Results of the loosest search
+			SET_VECTOR_ELT(list, s, loose_list);
+			continue;
+		}
+		
+		for (int i = 0; i < NUM_TRI_TYPES; i++)
+			dl_list_init(&dl_list_arr[i], max_len);
+		
+		for (int i = 0; i < ntypes; i++)
+		{// Search windows of the set type by type
+			t_params *set = &sets[s*ntypes + i];
+			intv_t *window = get_sweep_chunks(&sw[i], sweep_level(&sw[i], set->min_score), chunk);
+			
+			main_search(dna, window, set, 1, &pen, &pb_none, &dl_list_arr[i], nthreads, &tune, NULL);
+			free_intv(window);
+		}
+		SET_VECTOR_ELT(list, s, search_results(dl_list_arr, &tune));
 	}
 	
-	dl_list_merge_sort(dl_list_arr, &dl_list, NUM_TRI_TYPES);
-	list = export_results(&dl_list);
-	dl_list_free(&dl_list);
+	for (int i = 0; i < ntypes; i++)
+		sweep_free(&sw[i]);
 	
-	free(dna.seq);
+	free(sets);
+	free(scores);
+	seq_free(&dna);
 	free_intv(chunk);
 	
+	UNPROTECT(2);
 	return list;
 }
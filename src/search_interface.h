@@ -16,6 +16,7 @@
 #include <Rinternals.h>
 
 #include "libtriplex.h"
+#include "dl_list.h"
 
 
 typedef enum
@@ -42,7 +43,15 @@ typedef enum
 	P_INS_PEN,
 	P_ISO_PEN,
 	P_ISO_BONUS,
-	P_MIS_PEN
+	P_MIS_PEN,
+	P_THREADS,
+	P_STREAM,
+	P_PIECE_SIZE,
+	P_CACHE_BUDGET,
+	P_SEED_LEN,
+	P_TRACE,
+	P_PREFILTER,
+	P_SEED_BAND
 } rparams_t;
 
 
@@ -50,11 +59,15 @@ SEXP triplex_search(
 	SEXP dnaobject, SEXP type, SEXP seq_type, SEXP params,
 	SEXP st_par, SEXP st_apar, SEXP gt_par, SEXP gt_apar,
 	SEXP pbw);
+SEXP triplex_sweep(
+	SEXP dnaobject, SEXP type, SEXP seq_type, SEXP params, SEXP sweep,
+	SEXP st_par, SEXP st_apar, SEXP gt_par, SEXP gt_apar,
+	SEXP pbw);
 seq_t decode_DNAString(SEXP dnaobject, int seq_type);
 void set_score_group_tables(int *st_par, int *st_apar, int *gt_par, int *gt_apar);
 void save_result(
-	int start, int end,    int score, double pvalue, int insdel,
-	int type,  int lstart, int lend, int strand
+	t_dl_buf *buf, int64_t start, int64_t end, int score, double pvalue,
+	int insdel, int type, int64_t lstart, int64_t lend, int strand
 );
 
 #endif // SEARCH_INTERFACE_H
@@ -0,0 +1,279 @@
+/**
+ * Triplex package
+ * Mirror k-mer seeds of triplex search
+ *
+ * Triplex stem pairs bases of a mirror repeat, so a triplex of type t
+ * usually contains k consecutive strong triplets: bases s[i..i+k-1]
+ * paired with bases s[j..j-k+1] in reversed order. Bases are reduced to
+ * classes of strong triplets of the type, a purine/pyrimidine alphabet
+ * for the default tables, so that such a seed is a k-mer of classes read
+ * forward at i equal to the k-mer read backward at j. Seeds are found
+ * by a hash index of backward k-mers of the last bases and the search
+ * runs only in windows around them.
+ *
+ * @file    seed.c
+ * @package triplex
+ */
+
+#include <R.h>
+#include <Rinternals.h>
+
+#include <stdlib.h>
+
+#include "seed.h"
+
+
+/**
+ * Get base classes of strong triplets of given type
+ * Bases paired by triplets with the maximal score of the type get
+ * the same class, bases without such triplet get -1.
+ * @param tri_type Triplex type
+ * @param row Output classes of bases of the forward k-mer
+ * @param col Output classes of bases of the backward k-mer
+ * @return Number of classes
+ */
+static int seed_classes(int tri_type, int row[NBASES], int col[NBASES])
+{
+	int comp[2*NBASES], id[2*NBASES];
+	int strong = TM, nclass = 0;
+	
+	for (int a = 0; a < NBASES; a++)
+		for (int b = 0; b < NBASES; b++)
+			if (TAB_SCORE[tri_type][a][b] > strong)
+				strong = TAB_SCORE[tri_type][a][b];
+	
+	if (strong <= 0)
+		return 0;
+	
+	/* Components of bipartite graph of strong triplets, row bases
+	 * are nodes 0..NBASES-1 and column bases the next ones */
+	for (int n = 0; n < 2*NBASES; n++)
+	{
+		comp[n] = n;
+		id[n] = -1;
+	}
+	for (int a = 0; a < NBASES; a++)
+	{
+		for (int b = 0; b < NBASES; b++)
+		{
+			int from = comp[NBASES + b], to = comp[a];
+			if (TAB_SCORE[tri_type][a][b] != strong || from == to)
+				continue;
+			
+			for (int n = 0; n < 2*NBASES; n++)
+				if (comp[n] == from)
+					comp[n] = to;
+			id[to] = 0;
+		}
+	}
+	for (int n = 0; n < 2*NBASES; n++)
+	{// Number components with at least one triplet
+		if (id[n] == 0)
+			id[n] = ++nclass;
+	}
+	for (int a = 0; a < NBASES; a++)
+	{
+		row[a] = id[comp[a]] - 1;
+		col[a] = id[comp[NBASES + a]] - 1;
+	}
+	return nclass;
+}
+
+
+/**
+ * Get key of k-mer of base classes
+ * @param cls Base classes
+ * @param dna Encoded sequence, the k-mer lies in a chunk
+ * @param pos First base of the k-mer
+ * @param dir Direction of the k-mer, 1 forward or -1 backward
+ * @param k Length of the k-mer
+ * @param nclass Number of classes
+ * @return Key or -1 if some base has no class
+ */
+static inline int seed_key(
+	const int *cls, const seq_t *dna, int64_t pos, int dir, int k, int nclass)
+{
+	int key = 0;
+	
+	for (int t = k - 1; t >= 0; t--)
+	{
+		int ch = SEQ_BASE(*dna, pos + dir*t);
+		if (cls[ch] < 0)
+			return -1;
+		
+		key = key*nclass + cls[ch];
+	}
+	return key;
+}
+
+
+typedef struct
+{// Window around the seeds of one base
+	int64_t start;
+	int64_t end;
+	int first_ad;   /* First antidiagonal of its triplexes */
+	int last_ad;    /* Last antidiagonal of its triplexes */
+} t_window;
+
+
+/**
+ * Compare windows by start
+ * @param a Window
+ * @param b Window
+ * @return Comparison result for qsort
+ */
+static int window_cmp(const void *a, const void *b)
+{
+	const t_window *x = a, *y = b;
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+
+/**
+ * Get windows of chunks around mirror k-mer seeds of given type
+ * Seed pairs fix the loop length of triplexes spanning them up to
+ * the stem, so a seed on antidiagonals ad..ad+2k-2 is spanned only by
+ * triplexes on antidiagonals ad+2k-1-stem..ad+stem-1. Every window holds
+ * all such triplexes of its seeds, overlapping windows are merged with
+ * their antidiagonals. So the cost of a window grows with the stem and
+ * not with the range of loop lengths. A stem equal to the span gives
+ * windows of the whole span on all antidiagonals, which also hold
+ * triplexes near the seeds without a seed of their own.
+ * @param dna Encoded DNA sequence
+ * @param chunk Interval list of chunks divided by N or - symbols
+ * @param tri_type Triplex type
+ * @param seed_len Length of seeds, SEED_MIN_LEN..SEED_MAX_LEN
+ * @param min_ad Minimal antidiagonal of a triplex
+ * @param stem Maximal number of antidiagonals of a triplex stem or span
+ * @param span Maximal number of bases of a triplex, its antidiagonals
+ * @param band Output first antidiagonal and number of antidiagonals
+ *   of every window, two items per window
+ * @return Windows in sequence order
+ */
+intv_t *get_seed_chunks(
+	seq_t dna, intv_t *chunk, int tri_type, int seed_len, int min_ad,
+	int stem, int span, int **band)
+{
+	int row[NBASES], col[NBASES];
+	int nclass = seed_classes(tri_type, row, col);
+	int k = seed_len;
+	
+	/* Seed pairs are on antidiagonals ad..ad+2k-2 */
+	int max_ad = span - 2*k + 1;
+	int ring = 1;
+	int count = 0, nwin = 0, max_win = 64, max_out = 64;
+	
+	// Create first interval as a list header
+	intv_t header = {0, 0, NULL};
+	intv_t *last = &header;
+	
+	*band = NULL;
+	if (nclass == 0 || max_ad < min_ad)
+		return NULL;
+	
+	while (ring <= max_ad)
+		ring <<= 1;
+	
+	/* Chains of positions with the same bucket, the last max_ad
+	 * positions are kept in a ring */
+	int64_t *head = malloc(SEED_BUCKETS * sizeof(int64_t));
+	int64_t *prev = malloc(ring * sizeof(int64_t));
+	int *gkey = malloc(ring * sizeof(int));
+	t_window *win = malloc(max_win * sizeof(t_window));
+	int *out = malloc(2*max_out * sizeof(int));
+	if (head == NULL || prev == NULL || gkey == NULL || win == NULL || out == NULL)
+		error("Failed to allocate memory for seed index.");
+	
+	for (int h = 0; h < SEED_BUCKETS; h++)
+		head[h] = -1;
+	
+	for (intv_t *c = chunk; c != NULL; c = c->next)
+	{
+		nwin = 0;
+		for (int64_t i = c->start + k - 1 + min_ad; i + k - 1 <= c->end; i++)
+		{
+			// Index backward k-mer of the closest pair
+			int64_t j = i - min_ad;
+			int key = seed_key(col, &dna, j, -1, k, nclass);
+			if (key >= 0)
+			{
+				int h = key % SEED_BUCKETS;
+				prev[j & (ring-1)] = head[h];
+				gkey[j & (ring-1)] = key;
+				head[h] = j;
+			}
+			
+			key = seed_key(row, &dna, i, 1, k, nclass);
+			if (key < 0)
+				continue;
+			
+			int64_t limit = (i - max_ad > c->start + k - 1) ? i - max_ad : c->start + k - 1;
+			int64_t near = -1, far = -1;
+			
+			for (j = head[key % SEED_BUCKETS]; j >= limit; j = prev[j & (ring-1)])
+			{// Chain runs from the closest pair to the farthest one
+				if (gkey[j & (ring-1)] != key)
+					continue;
+				if (near < 0)
+					near = j;
+				far = j;
+			}
+			if (near < 0)
+				continue;
+			
+			int ad_near = i - near, ad_far = i - far;
+			int first_ad = ad_near + 2*k - 1 - stem;
+			int last_ad = (ad_far + stem - 1 < span - 1) ? ad_far + stem - 1 : span - 1;
+			int near_last = (ad_near + stem - 1 < span - 1) ? ad_near + stem - 1 : span - 1;
+			
+			if (nwin == max_win)
+			{
+				max_win *= 2;
+				win = realloc(win, max_win * sizeof(t_window));
+				if (win == NULL)
+					error("Failed to allocate memory for seed index.");
+			}
+			win[nwin].start = (i + k - 1 - last_ad > c->start) ? i + k - 1 - last_ad : c->start;
+			win[nwin].end = (near - k + 1 + near_last < c->end) ? near - k + 1 + near_last : c->end;
+			win[nwin].first_ad = (first_ad > min_ad) ? first_ad : min_ad;
+			win[nwin].last_ad = last_ad;
+			nwin++;
+		}
+		
+		/* Farther seeds start windows earlier, so merge them in order */
+		qsort(win, nwin, sizeof(t_window), window_cmp);
+		for (int w = 0; w < nwin; w++)
+		{
+			t_window m = win[w];
+			
+			for (; w + 1 < nwin && win[w+1].start <= m.end + 1; w++)
+			{
+				if (m.end < win[w+1].end)
+					m.end = win[w+1].end;
+				if (m.first_ad > win[w+1].first_ad)
+					m.first_ad = win[w+1].first_ad;
+				if (m.last_ad < win[w+1].last_ad)
+					m.last_ad = win[w+1].last_ad;
+			}
+			if (count == max_out)
+			{
+				max_out *= 2;
+				out = realloc(out, 2*max_out * sizeof(int));
+				if (out == NULL)
+					error("Failed to allocate memory for seed index.");
+			}
+			last->next = new_intv(m.start, m.end);
+			last = last->next;
+			out[2*count] = m.first_ad;
+			out[2*count+1] = m.last_ad + 1;
+			count++;
+		}
+	}
+	free(head);
+	free(prev);
+	free(gkey);
+	free(win);
+	
+	*band = out;
+	return header.next;
+}
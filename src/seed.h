@@ -0,0 +1,26 @@
+/**
+ * Triplex package
+ * Header file for mirror k-mer seeds of triplex search
+ *
+ * @file    seed.h
+ * @package triplex
+ */
+
+#ifndef SEED_H
+#define SEED_H
+
+#include "libtriplex.h"
+
+/* Allowed seed lengths, keys of longer seeds would not fit 32 bits */
+#define SEED_MIN_LEN 2
+#define SEED_MAX_LEN 12
+
+/* Number of hash buckets of the seed index, a prime */
+#define SEED_BUCKETS 65521
+
+intv_t *get_seed_chunks(
+	seq_t dna, intv_t *chunk, int tri_type, int seed_len, int min_ad,
+	int stem, int span, int **band
+);
+
+#endif // SEED_H
@@ -0,0 +1,181 @@
+/**
+ * Triplex package
+ * Parameter sweep of triplex search
+ *
+ * Scores of DP cells do not depend on min_score, p_value and min_len,
+ * these only decide which cells are of quality and which triplexes are
+ * exported. A cell in row i of antidiagonal ad depends only on bases
+ * i-ad..i, so a search of a window of the sequence computes the same
+ * cells as the search of the whole sequence. Searches with higher
+ * minimal scores are thus run only in windows around cells reaching
+ * their minimal score, which are marked by one search with the lowest
+ * one. Windows hold SWEEP_MARGIN bases more on both sides for the steps
+ * out of the triplex, which decide on its export. Pieces of a window
+ * export the same triplexes for any penalizations, @see get_pieces.
+ *
+ * @file    sweep.c
+ * @package triplex
+ */
+
+#include <R.h>
+#include <Rinternals.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sweep.h"
+#include "kernel.h"
+
+
+/**
+ * Initialize sweep of one triplex type
+ * @param sw Sweep
+ * @param min_score Minimal scores of searches, any order with duplicates
+ * @param n Number of minimal scores
+ * @param seq_len Sequence length
+ */
+void sweep_init(t_sweep *sw, const int *min_score, int n, int64_t seq_len)
+{
+	sw->nlevels = 0;
+	sw->nwords = (seq_len + 64*SWEEP_BLOCK - 1)/(64*SWEEP_BLOCK);
+	sw->min_score = malloc((n > 0 ? n : 1) * sizeof(int));
+	
+	for (int i = 0; i < n && sw->min_score != NULL; i++)
+	{// Sorted unique minimal scores
+		int j = sw->nlevels;
+		while (j > 0 && sw->min_score[j-1] > min_score[i])
+			j--;
+		if (j > 0 && sw->min_score[j-1] == min_score[i])
+			continue;
+		
+		memmove(sw->min_score + j + 1, sw->min_score + j, (sw->nlevels - j) * sizeof(int));
+		sw->min_score[j] = min_score[i];
+		sw->nlevels++;
+	}
+	sw->mark = calloc((size_t) sw->nlevels * sw->nwords + 1, sizeof(uint64_t));
+	if (sw->min_score == NULL || sw->mark == NULL)
+		error("Failed to allocate memory for parameter sweep.");
+}
+
+
+/**
+ * Mark bases of cells of one antidiagonal
+ * Every cell marks its bases at the highest level its score reaches,
+ * so the window of a level is the union of marks of the higher ones.
+ * Threads searching other pieces may mark the same words.
+ * @param sw Sweep
+ * @param ds Diagonal state
+ * @param k Index of the first cell in ds
+ * @param ad Antidiagonal number
+ * @param first Row of the first cell in sequence
+ * @param count Number of cells
+ */
+void sweep_mark(t_sweep *sw, const t_dstate *ds, int k, int ad, int64_t first, int count)
+{
+	int low = sw->min_score[0];
+	int level = 0;
+	int64_t done = -1;
+	
+	/* Most cells are under the lowest minimal score */
+	for (int j = scores_find(ds, k, count, low); j < count; j += 1 + scores_find(ds, k + j + 1, count - j - 1, low))
+	{
+		int score = DS_GET(ds, score, k + j);
+		int l = sw->nlevels - 1;
+		while (sw->min_score[l] > score)
+			l--;
+		
+		int64_t start = (first + j - ad - SWEEP_MARGIN)/SWEEP_BLOCK;
+		int64_t stop = (first + j + SWEEP_MARGIN)/SWEEP_BLOCK;
+		
+		if (l == level && start <= done)
+		// Blocks marked by the previous cell
+			start = done + 1;
+		if (start < 0)
+			start = 0;
+		if (stop >= 64*sw->nwords)
+			stop = 64*sw->nwords - 1;
+		
+		uint64_t *mark = sw->mark + (size_t) l*sw->nwords;
+		for (int64_t b = start; b <= stop; b++)
+		{
+			uint64_t bit = (uint64_t) 1 << (b & 63);
+			if (!(mark[b >> 6] & bit))
+				__atomic_fetch_or(&mark[b >> 6], bit, __ATOMIC_RELAXED);
+		}
+		level = l;
+		done = stop;
+	}
+}
+
+
+/**
+ * Get level of minimal score
+ * @param sw Sweep
+ * @param min_score Minimal score given to sweep_init
+ * @return Level index, -1 if not found
+ */
+int sweep_level(const t_sweep *sw, int min_score)
+{
+	for (int level = 0; level < sw->nlevels; level++)
+		if (sw->min_score[level] == min_score)
+			return level;
+	
+	return -1;
+}
+
+
+/**
+ * Get windows of chunks to search with minimal score of given level
+ * @param sw Sweep marked by the search with the lowest minimal score
+ * @param level Level of the minimal score
+ * @param chunk Interval list of chunks divided by N or - symbols
+ * @return Windows in sequence order
+ */
+intv_t *get_sweep_chunks(const t_sweep *sw, int level, intv_t *chunk)
+{
+	// Create first interval as a list header
+	intv_t header = {0, 0, NULL};
+	intv_t *last = &header;
+	
+	for (intv_t *c = chunk; c != NULL; c = c->next)
+	{
+		int64_t b = c->start/SWEEP_BLOCK, end_b = c->end/SWEEP_BLOCK;
+		int64_t first = -1;
+		
+		for (; b <= end_b + 1; b++)
+		{
+			int marked = 0;
+			
+			/* Union of marks of the higher levels */
+			for (int l = level; b <= end_b && l < sw->nlevels && !marked; l++)
+				marked = (sw->mark[(size_t) l*sw->nwords + (b >> 6)] >> (b & 63)) & 1;
+			
+			if (marked && first < 0)
+				first = b;
+			else if (!marked && first >= 0)
+			{// Export run of marked blocks
+				int64_t start = (first*SWEEP_BLOCK > c->start) ? first*SWEEP_BLOCK : c->start;
+				int64_t end = (b*SWEEP_BLOCK - 1 < c->end) ? b*SWEEP_BLOCK - 1 : c->end;
+				
+				last->next = new_intv(start, end);
+				last = last->next;
+				first = -1;
+			}
+		}
+	}
+	return header.next;
+}
+
+
+/**
+ * Free sweep of one triplex type
+ * @param sw Sweep
+ */
+void sweep_free(t_sweep *sw)
+{
+	free(sw->min_score);
+	free(sw->mark);
+	sw->min_score = NULL;
+	sw->mark = NULL;
+	sw->nlevels = 0;
+}
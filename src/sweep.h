@@ -0,0 +1,38 @@
+/**
+ * Triplex package
+ * Header file for parameter sweep of triplex search
+ *
+ * @file    sweep.h
+ * @package triplex
+ */
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdint.h>
+
+#include "libtriplex.h"
+#include "interval.h"
+#include "kernel.h"
+
+/* Number of bases marked by one bit, @see sweep_mark */
+#define SWEEP_BLOCK 64
+
+/* Bases around a cell, which decide on exports of its triplex */
+#define SWEEP_MARGIN 2
+
+typedef struct
+{// Windows of searches with higher minimal scores of one triplex type
+	int nlevels;          /* Number of minimal scores */
+	int *min_score;       /* Minimal scores in increasing order */
+	int64_t nwords;       /* Words of marks of one level */
+	uint64_t *mark;       /* Blocks of cells of every level, @see sweep_mark */
+} t_sweep;
+
+void sweep_init(t_sweep *sw, const int *min_score, int n, int64_t seq_len);
+void sweep_mark(t_sweep *sw, const t_dstate *ds, int k, int ad, int64_t first, int count);
+int sweep_level(const t_sweep *sw, int min_score);
+intv_t *get_sweep_chunks(const t_sweep *sw, int level, intv_t *chunk);
+void sweep_free(t_sweep *sw);
+
+#endif // SWEEP_H